@@ -1,28 +1,112 @@
 #include "abuf.h"
-#include <assert.h>
+#include "mem.h"
+#include <errno.h>
+#include <poll.h>
 #include <string.h>
+#include <sys/uio.h>
 
-void
-Abuf_init(struct Abuf* ab, size_t capacity)
+// chunks handed to a single writev
+#define ABUF_IOV (64)
+
+static struct AbufChunk*
+Abuf_chunk(void)
+{
+    struct AbufChunk* chunk = Mem_alloc(MEM_RENDER, sizeof(*chunk));
+    chunk->next = NULL;
+    chunk->len = 0;
+    return chunk;
+}
+
+struct Abuf*
+Abuf_new(void)
 {
+    struct Abuf* ab = Mem_alloc(MEM_RENDER, sizeof(*ab));
+    ab->head = ab->tail = Abuf_chunk();
     ab->len = 0;
-    ab->capacity = capacity;
-    ab->cursor = ab->buf;
+    return ab;
+}
+
+void
+Abuf_free(struct Abuf* ab)
+{
+    struct AbufChunk* next;
+    for (struct AbufChunk* chunk = ab->head; chunk; chunk = next) {
+        next = chunk->next;
+        Mem_free(MEM_RENDER, chunk, sizeof(*chunk));
+    }
+    Mem_free(MEM_RENDER, ab, sizeof(*ab));
 }
 
 void
 Abuf_append(struct Abuf* ab, const char* s, size_t len)
 {
-    assert(ab->len + len <= ab->capacity);
-    memcpy(ab->cursor, s, len);
-    ab->cursor += len;
     ab->len += len;
+    while (len) {
+        struct AbufChunk* tail = ab->tail;
+        if (tail->len == ABUF_CHUNK) {
+            if (!tail->next) {
+                tail->next = Abuf_chunk();
+            }
+            tail = ab->tail = tail->next;
+            tail->len = 0;
+        }
+        size_t n = ABUF_CHUNK - tail->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&tail->buf[tail->len], s, n);
+        tail->len += n;
+        s += n;
+        len -= n;
+    }
+}
+
+// write everything appended so far to fd with writev, resuming after short
+// writes and waiting out EAGAIN on a non-blocking fd. Returns the number of
+// bytes written, or -1 with errno set.
+ssize_t
+Abuf_write(struct Abuf* ab, int fd)
+{
+    struct AbufChunk* chunk = ab->head;
+    size_t off = 0;
+    size_t written = 0;
+    while (written < ab->len) {
+        struct iovec iov[ABUF_IOV];
+        int n = 0;
+        for (struct AbufChunk* c = chunk; n < ABUF_IOV; c = c->next) {
+            iov[n].iov_base = &c->buf[c == chunk ? off : 0];
+            iov[n].iov_len = c->len - (c == chunk ? off : 0);
+            n++;
+            if (c == ab->tail) {
+                break;
+            }
+        }
+        ssize_t w = writev(fd, iov, n);
+        if (w == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+                poll(&pfd, 1, -1);
+                continue;
+            } else if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        written += w;
+        // skip what was written, stopping inside the chunk it ended in
+        off += w;
+        while (chunk != ab->tail && off >= chunk->len) {
+            off -= chunk->len;
+            chunk = chunk->next;
+        }
+    }
+    return written;
 }
 
 void
 Abuf_reset(struct Abuf* ab)
 {
-    ab->cursor = ab->buf;
-    ab->buf[0] = '\0';
+    ab->tail = ab->head;
+    ab->head->len = 0;
     ab->len = 0;
 }
@@ -1,20 +1,38 @@
 #ifndef ABUF
 #define ABUF
 #include <stdlib.h>
+#include <sys/types.h>
+
+#define ABUF_CHUNK (16 * 1024)
+
+struct AbufChunk
+{
+    struct AbufChunk* next;
+    size_t len;
+    char buf[ABUF_CHUNK];
+};
+
+// An output buffer made of chunks, so it grows without copying. Chunks are
+// kept on reset and reused by the next frame.
 struct Abuf
 {
-    char* cursor;
+    struct AbufChunk* head;
+    struct AbufChunk* tail; // the chunk being appended to
     size_t len;
-    size_t capacity;
-    char buf[];
 };
 
+struct Abuf*
+Abuf_new(void);
+
 void
-Abuf_init(struct Abuf* ab, size_t capacity);
+Abuf_free(struct Abuf* ab);
 
 void
 Abuf_append(struct Abuf* ab, const char* s, size_t len);
 
+ssize_t
+Abuf_write(struct Abuf* ab, int fd);
+
 void
 Abuf_reset(struct Abuf* ab);
 
@@ -0,0 +1,225 @@
+#include "batch.h"
+#include "gap.h"
+#include "re.h"
+#include "save.h"
+#include "texter.h"
+#include "undo.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// how the escapes of an argument are decoded, see unescape
+enum Escapes
+{
+    ESC_TEXT,    // all of them, and any other is an error
+    ESC_PATTERN, // all of them, and any other stands for itself
+    ESC_REGEX,   // only \xHH, the rest are for Re_compile
+};
+
+// decode the escapes in `s` in place, as far as `mode` goes: \n \r \t \e
+// \s (a space) \\ and \xHH. Returns the decoded length, or -1 on a bad one.
+static ssize_t
+unescape(char* s, enum Escapes mode)
+{
+    char* out = s;
+    for (char* in = s; *in; in++) {
+        if (*in != '\\') {
+            *out++ = *in;
+            continue;
+        }
+        if (mode == ESC_REGEX && in[1] != 'x') {
+            *out++ = *in;
+            if (in[1]) {
+                *out++ = *++in;
+            }
+            continue;
+        }
+        switch (*++in) {
+            case 'n':
+                *out++ = '\n';
+                break;
+            case 'r':
+                *out++ = '\r';
+                break;
+            case 't':
+                *out++ = '\t';
+                break;
+            case 'e':
+                *out++ = '\x1b';
+                break;
+            case 's':
+                *out++ = ' ';
+                break;
+            case '\\':
+                *out++ = '\\';
+                break;
+            case 'x': {
+                if (!isxdigit(in[1]) || !isxdigit(in[2])) {
+                    return -1;
+                }
+                char hex[3] = { in[1], in[2], '\0' };
+                *out++ = strtol(hex, NULL, 16);
+                in += 2;
+                break;
+            }
+            default:
+                if (mode == ESC_TEXT || !*in) {
+                    return -1;
+                }
+                *out++ = '\\';
+                *out++ = *in;
+                break;
+        }
+    }
+    *out = '\0';
+    return out - s;
+}
+
+static void
+go_to(struct EditorContext* ctx, ssize_t line, ssize_t col)
+{
+    ssize_t last = Gap_index_lines(ctx->gap, line) - 1;
+    ctx->cy = line < 1 ? 0 : line - 1 < last ? line - 1 : last;
+    ssize_t len = Gap_line_len(ctx->gap, ctx->cy);
+    ctx->cx = col < 1 ? 0 : col - 1 < len ? col - 1 : len;
+    Undo_seal(ctx->undo);
+}
+
+// save to `filename`, or stdout if it is "-", before going on
+static int
+save_to(struct EditorContext* ctx, const char* filename)
+{
+    if (!strcmp(filename, "-")) {
+        return Gap_write(ctx->gap, STDOUT_FILENO, NULL) == -1 ? -1 : 0;
+    }
+    if (Save_file(ctx->gap, filename, NULL) == -1) {
+        return -1;
+    }
+    ctx->dirty = 0;
+    return 0;
+}
+
+// one command, with the escapes in `arg` still to be decoded. Returns an
+// error message, or NULL.
+static const char*
+run_command(struct EditorContext* ctx, const char* cmd, char* arg)
+{
+    if (!strcmp(cmd, "keys") || !strcmp(cmd, "type")) {
+        ssize_t len = unescape(arg, ESC_TEXT);
+        if (len == -1) {
+            return "bad escape";
+        } else if (cmd[0] == 't') {
+            text_insert(ctx, cursor_offset(ctx), arg, len);
+            return NULL;
+        }
+        ctx->batch_keys = arg;
+        ctx->batch_left = len;
+        while (input_pending(ctx)) {
+            handle_input(ctx, read_input(ctx));
+        }
+    } else if (!strcmp(cmd, "goto")) {
+        ssize_t line, col = 1;
+        if (sscanf(arg, "%zd %zd", &line, &col) < 1) {
+            return "expected a line number";
+        }
+        go_to(ctx, line, col);
+    } else if (!strcmp(cmd, "delete")) {
+        ssize_t len;
+        if (sscanf(arg, "%zd", &len) != 1 || len < 0) {
+            return "expected a number of bytes";
+        }
+        ssize_t at = cursor_offset(ctx);
+        len = len < ctx->gap->size - at ? len : ctx->gap->size - at;
+        if (len) {
+            text_delete(ctx, at, len);
+        }
+    } else if (!strcmp(cmd, "replace") || !strcmp(cmd, "regex")) {
+        char* with = strchr(arg, ' ');
+        with = with ? (*with = '\0', with + 1) : &arg[strlen(arg)];
+        int regex = !strcmp(cmd, "regex");
+        ssize_t len = unescape(arg, regex ? ESC_REGEX : ESC_PATTERN);
+        if (len <= 0 || unescape(with, ESC_TEXT) == -1) {
+            return len ? "bad escape" : "expected a pattern";
+        }
+        if (regex) {
+            const char* err;
+            struct Regex* re = Re_compile(arg, len, &err);
+            if (!re) {
+                return err;
+            }
+            Re_free(re);
+        }
+        replace_all(ctx, arg, len, regex, with);
+    } else if (!strcmp(cmd, "undo")) {
+        undo(ctx);
+    } else if (!strcmp(cmd, "redo")) {
+        redo(ctx);
+    } else if (!strcmp(cmd, "save")) {
+        const char* filename = *arg ? arg : ctx->filename;
+        if (!filename) {
+            return "no file name";
+        } else if (unescape(arg, ESC_TEXT) == -1) {
+            return "bad escape";
+        } else if (save_to(ctx, filename) == -1) {
+            return strerror(errno);
+        }
+    } else {
+        return "unknown command";
+    }
+    return NULL;
+}
+
+// Run the commands of an edit script, one per line, against the editor as
+// it would run on a terminal, but with nothing drawn. Lines starting with
+// # are comments. The commands are
+//   keys TEXT          type TEXT as keys, e.g. keys \x06foo\r finds foo
+//   type TEXT          insert TEXT at the cursor as one edit
+//   goto LINE [COL]    move the cursor, counting from 1
+//   delete N           delete N bytes at the cursor
+//   replace PAT [WITH] replace every match of PAT, literally
+//   regex PAT [WITH]   the same for a regular expression
+//   undo, redo
+//   save [FILE]        save the text to FILE, the file being edited, or to
+//                      stdout if FILE is -
+// Arguments may use the escapes \n \r \t \e \s \\ and \xHH, and keys end
+// with an Escape for any prompt they leave open. A literal pattern keeps
+// other escapes as they are, and a regex only decodes \xHH, leaving the
+// rest to the regex syntax: regex \d+ N replaces numbers. Status messages
+// go to stderr. Returns the exit status: failure at the first bad command.
+int
+Batch_run(struct EditorContext* ctx, FILE* script, const char* name)
+{
+    char* line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    int status = EXIT_SUCCESS;
+    for (int n = 1; (len = getline(&line, &cap, script)) != -1; n++) {
+        if (len && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+        if (!len || line[0] == '#') {
+            continue;
+        }
+        char* arg = strchr(line, ' ');
+        arg = arg ? (*arg = '\0', arg + 1) : &line[len];
+        ctx->status_msg[0] = '\0';
+        const char* err = run_command(ctx, line, arg);
+        editor_idle(ctx);
+        if (err) {
+            fprintf(stderr, "%s:%d: %s: %s\n", name, n, line, err);
+            status = EXIT_FAILURE;
+            break;
+        } else if (ctx->status_msg[0]) {
+            fprintf(stderr, "%s:%d: %s\n", name, n, ctx->status_msg);
+        }
+    }
+    free(line);
+    if (ctx->save->state != SAVE_IDLE &&
+        Save_wait(ctx->save) == SAVE_FAILED) {
+        fprintf(stderr, "%s: failed to save buffer\n", name);
+        status = EXIT_FAILURE;
+    }
+    return status;
+}
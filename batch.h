@@ -0,0 +1,9 @@
+#ifndef BATCH
+#define BATCH
+#include <stdio.h>
+
+struct EditorContext;
+
+int
+Batch_run(struct EditorContext* ctx, FILE* script, const char* name);
+#endif // !BATCH
@@ -0,0 +1,92 @@
+#include "event.h"
+#include "mem.h"
+#include "util.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// SIGWINCH is blocked and read from a signalfd instead. Threads inherit
+// the blocked signal, so this must run before any other thread starts.
+struct EventLoop*
+Event_new(int in)
+{
+    struct EventLoop* loop = Mem_alloc(MEM_OTHER, sizeof(*loop));
+    loop->in = in;
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    if (pthread_sigmask(SIG_BLOCK, &mask, NULL)) {
+        unix_error("pthread_sigmask");
+    }
+    loop->sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (loop->sigfd == -1) {
+        unix_error("signalfd");
+    }
+    loop->timerfd =
+      timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (loop->timerfd == -1) {
+        unix_error("timerfd_create");
+    }
+    return loop;
+}
+
+// fire the timer once at `when`, in seconds of Event_now
+void
+Event_timer_at(struct EventLoop* loop, time_t when)
+{
+    struct itimerspec spec = { .it_value = { .tv_sec = when } };
+    if (timerfd_settime(loop->timerfd, TFD_TIMER_ABSTIME, &spec, NULL)) {
+        unix_error("timerfd_settime");
+    }
+}
+
+// block until there is input, a resize or the timer fires, or for at most
+// `timeout` ms if it is not negative. Returns the EVENT_ bits that woke it.
+int
+Event_wait(struct EventLoop* loop, int timeout)
+{
+    struct pollfd fds[] = {
+        { .fd = loop->in, .events = POLLIN },
+        { .fd = loop->sigfd, .events = POLLIN },
+        { .fd = loop->timerfd, .events = POLLIN },
+    };
+    if (poll(fds, 3, timeout) == -1) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        unix_error("poll");
+    }
+    int events = 0;
+    if (fds[0].revents) {
+        events |= EVENT_INPUT;
+    }
+    if (fds[0].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+        events |= EVENT_HANGUP;
+    }
+    if (fds[1].revents & POLLIN) {
+        struct signalfd_siginfo info;
+        while (read(loop->sigfd, &info, sizeof(info)) == sizeof(info))
+            ;
+        events |= EVENT_RESIZE;
+    }
+    if (fds[2].revents & POLLIN) {
+        uint64_t expired;
+        read(loop->timerfd, &expired, sizeof(expired));
+        events |= EVENT_TIMER;
+    }
+    return events;
+}
+
+// seconds on the clock the timer runs on
+time_t
+Event_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
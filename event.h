@@ -0,0 +1,31 @@
+#ifndef EVENT_LOOP
+#define EVENT_LOOP
+#include <time.h>
+
+// what woke Event_wait, combined as bits. 0 means it timed out.
+#define EVENT_INPUT (1)
+#define EVENT_RESIZE (2)
+#define EVENT_TIMER (4)
+#define EVENT_HANGUP (8)
+
+// Waits on an input fd, a signalfd for SIGWINCH and a one-shot timerfd,
+// so the editor sleeps until something needs doing.
+struct EventLoop
+{
+    int in;
+    int sigfd;
+    int timerfd;
+};
+
+struct EventLoop*
+Event_new(int in);
+
+void
+Event_timer_at(struct EventLoop* loop, time_t when);
+
+int
+Event_wait(struct EventLoop* loop, int timeout);
+
+time_t
+Event_now(void);
+#endif // !EVENT_LOOP
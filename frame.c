@@ -0,0 +1,202 @@
+#include "frame.h"
+#include "abuf.h"
+#include "mem.h"
+#include <stdio.h>
+#include <string.h>
+
+#define ERASE_LINE ("\x1b[K")
+
+struct Frame*
+Frame_new(ssize_t rows, ssize_t cols)
+{
+    struct Frame* frame = Mem_alloc(MEM_RENDER, sizeof(*frame));
+    frame->rows = rows;
+    frame->cols = cols;
+    frame->text = Mem_alloc(MEM_RENDER, rows * cols);
+    frame->attr = Mem_alloc(MEM_RENDER, rows * cols);
+    frame->shown_text = Mem_alloc(MEM_RENDER, rows * cols);
+    frame->shown_attr = Mem_alloc(MEM_RENDER, rows * cols);
+    frame->bytes = 0;
+    frame->total_bytes = 0;
+    frame->frames = 0;
+    Frame_invalidate(frame);
+    Frame_clear(frame);
+    return frame;
+}
+
+void
+Frame_free(struct Frame* frame)
+{
+    size_t cells = frame->rows * frame->cols;
+    Mem_free(MEM_RENDER, frame->text, cells);
+    Mem_free(MEM_RENDER, frame->attr, cells);
+    Mem_free(MEM_RENDER, frame->shown_text, cells);
+    Mem_free(MEM_RENDER, frame->shown_attr, cells);
+    Mem_free(MEM_RENDER, frame, sizeof(*frame));
+}
+
+// forget what the terminal shows, so the next flush redraws every row
+void
+Frame_invalidate(struct Frame* frame)
+{
+    frame->valid = 0;
+}
+
+// blank the frame before drawing the next one
+void
+Frame_clear(struct Frame* frame)
+{
+    memset(frame->text, ' ', frame->rows * frame->cols);
+    memset(frame->attr, FRAME_PLAIN, frame->rows * frame->cols);
+}
+
+// draw `len` bytes at row, col, clipped to the width of the screen.
+// Returns the column after the last byte drawn.
+ssize_t
+Frame_put(struct Frame* frame,
+          ssize_t row,
+          ssize_t col,
+          const char* s,
+          ssize_t len,
+          int attr)
+{
+    if (row < 0 || row >= frame->rows || col >= frame->cols) {
+        return col;
+    }
+    if (len > frame->cols - col) {
+        len = frame->cols - col;
+    }
+    memcpy(&frame->text[row * frame->cols + col], s, len);
+    memset(&frame->attr[row * frame->cols + col], attr, len);
+    return col + len;
+}
+
+// fill the row with `c` from col to the end
+void
+Frame_fill(struct Frame* frame, ssize_t row, ssize_t col, char c, int attr)
+{
+    if (row < 0 || row >= frame->rows || col >= frame->cols) {
+        return;
+    }
+    memset(&frame->text[row * frame->cols + col], c, frame->cols - col);
+    memset(&frame->attr[row * frame->cols + col], attr, frame->cols - col);
+}
+
+// scroll rows top to bottom (inclusive) up by n, or down if n is negative,
+// using a terminal scroll region. The shown frame is shifted to match, so
+// the next flush only draws the rows scrolled into view.
+void
+Frame_scroll(struct Frame* frame,
+             struct Abuf* ab,
+             ssize_t top,
+             ssize_t bottom,
+             ssize_t n)
+{
+    ssize_t height = bottom - top + 1;
+    if (!frame->valid || n == 0 || n >= height || -n >= height) {
+        return;
+    }
+    char seq[64];
+    int len = snprintf(seq,
+                       sizeof(seq),
+                       "\x1b[%zd;%zdr\x1b[%zd%c\x1b[r",
+                       top + 1,
+                       bottom + 1,
+                       n > 0 ? n : -n,
+                       n > 0 ? 'S' : 'T');
+    Abuf_append(ab, seq, len);
+    ssize_t cols = frame->cols;
+    ssize_t kept = (height - (n > 0 ? n : -n)) * cols;
+    ssize_t from = (n > 0 ? top + n : top) * cols;
+    ssize_t to = (n > 0 ? top : top - n) * cols;
+    ssize_t blank = (n > 0 ? top + height - n : top) * cols;
+    memmove(&frame->shown_text[to], &frame->shown_text[from], kept);
+    memmove(&frame->shown_attr[to], &frame->shown_attr[from], kept);
+    memset(&frame->shown_text[blank], ' ', (height * cols) - kept);
+    memset(&frame->shown_attr[blank], FRAME_PLAIN, (height * cols) - kept);
+}
+
+static void
+emit_attr(struct Abuf* ab, int attr)
+{
+    if (attr == FRAME_PLAIN) {
+        Abuf_append(ab, "\x1b[m", 3);
+        return;
+    }
+    Abuf_append(ab, "\x1b[0", 4);
+    if (attr & FRAME_INVERSE) {
+        Abuf_append(ab, ";7", 2);
+    }
+    if (attr & FRAME_MATCH) {
+        // black on yellow
+        Abuf_append(ab, ";30;43", 6);
+    }
+    Abuf_append(ab, "m", 1);
+}
+
+// emit the changed part of one row: from the first to the last cell that
+// differs, or up to the start of a blank tail which is erased instead
+static void
+flush_row(struct Frame* frame, struct Abuf* ab, ssize_t row)
+{
+    ssize_t cols = frame->cols;
+    const char* text = &frame->text[row * cols];
+    const unsigned char* attr = &frame->attr[row * cols];
+    ssize_t first = 0, last = cols;
+    if (frame->valid) {
+        const char* shown_text = &frame->shown_text[row * cols];
+        const unsigned char* shown_attr = &frame->shown_attr[row * cols];
+        while (first < cols && text[first] == shown_text[first] &&
+               attr[first] == shown_attr[first]) {
+            first++;
+        }
+        if (first == cols) {
+            return;
+        }
+        while (text[last - 1] == shown_text[last - 1] &&
+               attr[last - 1] == shown_attr[last - 1]) {
+            last--;
+        }
+    }
+    ssize_t blank = cols;
+    while (blank > first && text[blank - 1] == ' ' &&
+           attr[blank - 1] == FRAME_PLAIN) {
+        blank--;
+    }
+    int erase = last > blank;
+    if (erase) {
+        last = blank;
+    }
+    char move[32];
+    int n = snprintf(move, sizeof(move), "\x1b[%zd;%zdH", row + 1, first + 1);
+    Abuf_append(ab, move, n);
+    int cur = FRAME_PLAIN;
+    for (ssize_t i = first, run; i < last; i = run) {
+        for (run = i; run < last && attr[run] == attr[i]; run++) {
+        }
+        if (attr[i] != cur) {
+            cur = attr[i];
+            emit_attr(ab, cur);
+        }
+        Abuf_append(ab, &text[i], run - i);
+    }
+    if (cur != FRAME_PLAIN) {
+        emit_attr(ab, FRAME_PLAIN);
+    }
+    if (erase) {
+        Abuf_append(ab, ERASE_LINE, strlen(ERASE_LINE));
+    }
+}
+
+// append the escape sequences that turn the shown frame into the new one.
+// The cursor is left wherever the last change was.
+void
+Frame_flush(struct Frame* frame, struct Abuf* ab)
+{
+    for (ssize_t row = 0; row < frame->rows; row++) {
+        flush_row(frame, ab, row);
+    }
+    memcpy(frame->shown_text, frame->text, frame->rows * frame->cols);
+    memcpy(frame->shown_attr, frame->attr, frame->rows * frame->cols);
+    frame->valid = 1;
+}
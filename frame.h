@@ -0,0 +1,60 @@
+#ifndef FRAME
+#define FRAME
+#include <sys/types.h>
+
+struct Abuf;
+
+// cell attributes, combined as bits
+#define FRAME_PLAIN (0)
+#define FRAME_INVERSE (1)
+#define FRAME_MATCH (2)
+
+// A shadow of the terminal screen. Each refresh draws into `text` and
+// `attr`, then Frame_flush emits only the cells that differ from what the
+// terminal already shows.
+struct Frame
+{
+    ssize_t rows, cols;
+    char* text;
+    unsigned char* attr;
+    char* shown_text;
+    unsigned char* shown_attr;
+    int valid;           // whether the shown cells match the terminal
+    size_t bytes;        // bytes emitted by the last flush
+    size_t total_bytes;  // bytes emitted by every flush so far
+    size_t frames;
+};
+
+struct Frame*
+Frame_new(ssize_t rows, ssize_t cols);
+
+void
+Frame_free(struct Frame* frame);
+
+void
+Frame_invalidate(struct Frame* frame);
+
+void
+Frame_clear(struct Frame* frame);
+
+ssize_t
+Frame_put(struct Frame* frame,
+          ssize_t row,
+          ssize_t col,
+          const char* s,
+          ssize_t len,
+          int attr);
+
+void
+Frame_fill(struct Frame* frame, ssize_t row, ssize_t col, char c, int attr);
+
+void
+Frame_scroll(struct Frame* frame,
+             struct Abuf* ab,
+             ssize_t top,
+             ssize_t bottom,
+             ssize_t n);
+
+void
+Frame_flush(struct Frame* frame, struct Abuf* ab);
+#endif // !FRAME
@@ -1,25 +1,458 @@
 
+// for mremap
+#define _GNU_SOURCE
 #include "gap.h"
+#include "lines.h"
+#include "mem.h"
 #include "util.h"
+#include "work.h"
+#include <errno.h>
 #include <stddef.h>
 #include <string.h>
-#define GAP_SIZE (16)
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static struct GapPolicy policy = {
+    .min_gap = 16,
+    .max_gap = MEGABYTES(64),
+    .grow_pct = 50,
+    .shrink_mul = 4,
+};
+
+// copies made because a snapshot was still reading the text, and their size
+static size_t unshared;
+static size_t unshared_bytes;
+
+void
+Gap_set_policy(const struct GapPolicy* p)
+{
+    policy = *p;
+    if (policy.min_gap < 1) {
+        policy.min_gap = 1;
+    }
+    if (policy.max_gap < policy.min_gap) {
+        policy.max_gap = policy.min_gap;
+    }
+}
+
+void
+Gap_get_policy(struct GapPolicy* p)
+{
+    *p = policy;
+}
+
+// gap the policy wants for a buffer holding `size` bytes of text
+static ssize_t
+Gap_target(ssize_t size)
+{
+    ssize_t target = size / 100 * policy.grow_pct;
+    if (target < policy.min_gap) {
+        target = policy.min_gap;
+    } else if (target > policy.max_gap) {
+        target = policy.max_gap;
+    }
+    return target;
+}
+
+// let go of the text: a snapshot sharing it takes it over, see
+// Gap_snapshot, otherwise it is freed
+static void
+Gap_drop_buf(struct GapBuffer* gap)
+{
+    if (gap->shared) {
+        gap->shared->shared = NULL;
+        gap->shared = NULL;
+    } else if (gap->mapped) {
+        munmap(gap->buf, gap->mapped);
+        Mem_count(MEM_MAPPED, -(ssize_t)gap->mapped);
+    } else {
+        Mem_free(MEM_TEXT, gap->buf, gap->capacity + 1);
+    }
+    gap->mapped = 0;
+}
+
+// reopen the gap to `gap_len` bytes, moving the text after the gap (and the
+// terminator) to its new place
+static void
+Gap_resize(struct GapBuffer* gap, ssize_t gap_len)
+{
+    ssize_t tail = gap->size - gap->cur_beg + 1;
+    ssize_t capacity = gap->size + gap_len;
+    if (gap->mapped || gap->shared) {
+        // neither a mapping nor text a snapshot is reading can be resized
+        // in place, move the text to the heap
+        char* buf = Mem_alloc(MEM_TEXT, capacity + 1);
+        memcpy(buf, gap->buf, gap->cur_beg);
+        memcpy(&buf[gap->cur_beg + gap_len], &gap->buf[gap->cur_end], tail);
+        if (gap->shared) {
+            unshared++;
+            unshared_bytes += gap->size;
+        }
+        Gap_drop_buf(gap);
+        gap->buf = buf;
+        gap->cur_end = gap->cur_beg + gap_len;
+        gap->capacity = capacity;
+        return;
+    }
+    if (capacity > gap->capacity) {
+        gap->buf =
+          Mem_realloc(MEM_TEXT, gap->buf, gap->capacity + 1, capacity + 1);
+    }
+    memmove(&gap->buf[gap->cur_beg + gap_len], &gap->buf[gap->cur_end], tail);
+    if (capacity < gap->capacity) {
+        gap->buf =
+          Mem_realloc(MEM_TEXT, gap->buf, gap->capacity + 1, capacity + 1);
+    }
+    gap->cur_end = gap->cur_beg + gap_len;
+    gap->capacity = capacity;
+}
+
+// make room for at least `len` more bytes at the cursor
+static void
+Gap_reserve(struct GapBuffer* gap, ssize_t len)
+{
+    if (gap->cur_end - gap->cur_beg >= len) {
+        return;
+    }
+    ssize_t gap_len = Gap_target(gap->size + len);
+    Gap_resize(gap, gap_len > len ? gap_len : len);
+}
+
+// about to write over [from, to) of buf: unless that lies in the gap of a
+// snapshot sharing the text, move to a copy of it first
+static void
+Gap_touch(struct GapBuffer* gap, ssize_t from, ssize_t to)
+{
+    struct GapBuffer* snap = gap->shared;
+    if (snap && from < to && (from < snap->cur_beg || to > snap->cur_end)) {
+        Gap_resize(gap, gap->cur_end - gap->cur_beg);
+    }
+}
 
 struct GapBuffer*
 Gap_new(char* buf)
 {
     size_t sz = strlen(buf);
-    struct GapBuffer* gap = Malloc(sizeof(*gap));
+    struct GapBuffer* gap = Mem_alloc(MEM_TEXT, sizeof(*gap));
+    ssize_t gap_len = policy.min_gap;
     gap->size = sz;
+    gap->capacity = sz + gap_len;
+    gap->cur_beg = 0;
+    gap->cur_end = gap_len;
+    gap->buf = Mem_alloc(MEM_TEXT, gap->capacity + 1);
+    memset(gap->buf, 0, gap_len);
+    memcpy(gap->buf + gap_len, buf, sz);
+    gap->buf[gap->capacity] = '\0';
+    gap->mapped = 0;
+    gap->lines = NULL;
+    gap->indexed = 0;
+    gap->shared = NULL;
+    gap->edits = 0;
+    return gap;
+}
+
+// a gap buffer over the first `size` bytes of `fd`. The file is mapped
+// private and copy-on-write right after the gap, so nothing is read until
+// it is touched and edits never reach the file. Returns NULL if the file
+// can't be mapped.
+struct GapBuffer*
+Gap_map(int fd, ssize_t size)
+{
+    ssize_t page = sysconf(_SC_PAGESIZE);
+    ssize_t gap_len = (Gap_target(size) + page - 1) / page * page;
+    // the page after the text is zeroed, which terminates the buffer
+    size_t mapped = gap_len + (size + page) / page * page;
+    char* buf = mmap(NULL,
+                     mapped,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS,
+                     -1,
+                     0);
+    if (buf == MAP_FAILED) {
+        return NULL;
+    }
+    if (mmap(buf + gap_len,
+             size,
+             PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED,
+             fd,
+             0) == MAP_FAILED) {
+        munmap(buf, mapped);
+        return NULL;
+    }
+    Mem_count(MEM_MAPPED, mapped);
+    struct GapBuffer* gap = Mem_alloc(MEM_TEXT, sizeof(*gap));
+    gap->size = size;
+    gap->capacity = size + gap_len;
     gap->cur_beg = 0;
-    gap->cur_end = GAP_SIZE;
-    gap->buf = Malloc(GAP_SIZE + sz + 1);
-    memset(gap->buf, 0, GAP_SIZE);
-    memcpy(gap->buf + GAP_SIZE, buf, sz);
-    gap->buf[sz + GAP_SIZE] = '\0';
+    gap->cur_end = gap_len;
+    gap->buf = buf;
+    gap->mapped = mapped;
+    gap->lines = NULL;
+    gap->indexed = 0;
+    gap->shared = NULL;
+    gap->edits = 0;
     return gap;
 }
 
+// move the text of a mapped buffer to the heap, so it no longer reads the
+// file it was mapped from, e.g. before that file is written over
+void
+Gap_unmap(struct GapBuffer* gap)
+{
+    if (gap->mapped) {
+        Gap_resize(gap, gap->cur_end - gap->cur_beg);
+    }
+}
+
+// A view of the text for another thread, e.g. a save, that shares the
+// buffer rather than copying it. Edits that only write into the gap as
+// the snapshot sees it, like typing or deleting where it was taken, leave
+// its text alone; any other edit moves `gap` to a copy of its own first.
+// One snapshot at a time. It is allocated from `arena` and handed to
+// Gap_release, not Gap_free, once the thread is done.
+struct GapBuffer*
+Gap_snapshot(struct GapBuffer* gap, struct BumpAlloc* arena)
+{
+    struct GapBuffer* snap = Bump_alloc_raw(arena, sizeof(*snap));
+    *snap = *gap;
+    snap->lines = NULL;
+    snap->indexed = 0;
+    snap->shared = gap;
+    gap->shared = snap;
+    return snap;
+}
+
+// done with a snapshot: the text goes back to the buffer it was taken of,
+// or is freed if that buffer has moved on to a copy
+void
+Gap_release(struct GapBuffer* snapshot)
+{
+    Gap_drop_buf(snapshot);
+}
+
+// how many copies snapshots have cost, and how many bytes they came to
+size_t
+Gap_unshared(size_t* bytes)
+{
+    *bytes = unshared_bytes;
+    return unshared;
+}
+
+void
+Gap_free(struct GapBuffer* gap)
+{
+    if (gap->lines) {
+        Lines_free(gap->lines);
+    }
+    Gap_drop_buf(gap);
+    Mem_free(MEM_TEXT, gap, sizeof(*gap));
+}
+
+// contiguous bytes starting at logical `offset`, up to the gap or the end
+static const char*
+Gap_at(struct GapBuffer* gap, ssize_t offset, ssize_t* avail)
+{
+    if (offset < gap->cur_beg) {
+        *avail = gap->cur_beg - offset;
+        return &gap->buf[offset];
+    }
+    *avail = gap->size - offset;
+    return &gap->buf[gap->cur_end + offset - gap->cur_beg];
+}
+
+#define INDEX_BATCH (1024)
+#define INDEX_CHUNK (KILOBYTES(64))
+// smallest slice of text worth handing to a worker thread
+#define INDEX_SLICE (MEGABYTES(1))
+
+static struct WorkPool* workers;
+
+// lets large indexing steps run on `pool`, NULL to index on the caller
+void
+Gap_set_workers(struct WorkPool* pool)
+{
+    workers = pool;
+}
+
+struct IndexSlice
+{
+    const char* text;
+    ssize_t len;
+    struct LineIndex* lines;
+};
+
+static void
+Gap_index_slice(void* arg, int job)
+{
+    struct IndexSlice* slice = &((struct IndexSlice*)arg)[job];
+    slice->lines = Lines_new();
+    Lines_append(slice->lines, slice->text, slice->len);
+}
+
+// index [indexed, to) on the worker pool: every slice is indexed on its own
+// and the results are joined in order
+static void
+Gap_index_parallel(struct GapBuffer* gap, ssize_t to)
+{
+    int jobs = Work_threads(workers) * 4;
+    ssize_t slice_len = (to - gap->indexed + jobs - 1) / jobs;
+    if (slice_len < INDEX_SLICE) {
+        slice_len = INDEX_SLICE;
+    }
+    // the range may straddle the gap, which can add one slice
+    size_t slices_size = sizeof(struct IndexSlice) * (jobs + 1);
+    struct IndexSlice* slices = Mem_alloc(MEM_LINES, slices_size);
+    int n = 0;
+    for (ssize_t from = gap->indexed; from < to; n++) {
+        ssize_t avail;
+        slices[n].text = Gap_at(gap, from, &avail);
+        slices[n].len = avail < to - from ? avail : to - from;
+        if (slices[n].len > slice_len) {
+            slices[n].len = slice_len;
+        }
+        from += slices[n].len;
+    }
+    Work_run(workers, Gap_index_slice, slices, n);
+    for (int i = 0; i < n; i++) {
+        Lines_concat(gap->lines, slices[i].lines);
+    }
+    Mem_free(MEM_LINES, slices, slices_size);
+}
+
+// split the last line of the index at every newline in [indexed, to)
+static void
+Gap_index_text(struct GapBuffer* gap, ssize_t to)
+{
+    struct LineIndex* idx = gap->lines;
+    // the last line runs to the end of the text, cut it back to the part
+    // that is already indexed while appending
+    Lines_extend(idx, gap->indexed - gap->size);
+    if (workers && Work_threads(workers) > 1 &&
+        to - gap->indexed >= 2 * INDEX_SLICE) {
+        Gap_index_parallel(gap, to);
+    } else {
+        for (ssize_t from = gap->indexed; from < to;) {
+            ssize_t avail;
+            const char* p = Gap_at(gap, from, &avail);
+            if (avail > to - from) {
+                avail = to - from;
+            }
+            Lines_append(idx, p, avail);
+            from += avail;
+        }
+    }
+    Lines_extend(idx, gap->size - to);
+    gap->indexed = to;
+}
+
+// The index is created on first use and filled lazily: newlines before
+// gap->indexed are in it, and its last line runs to the end of the text.
+static struct LineIndex*
+Gap_index(struct GapBuffer* gap)
+{
+    if (!gap->lines) {
+        gap->lines = Lines_new();
+        Lines_replace(gap->lines, 0, 1, &gap->size, 1);
+        gap->indexed = 0;
+    }
+    return gap->lines;
+}
+
+// make sure every newline before `offset` is indexed
+static void
+Gap_index_to(struct GapBuffer* gap, ssize_t offset)
+{
+    Gap_index(gap);
+    if (offset > gap->indexed) {
+        Gap_index_text(gap, offset < gap->size ? offset : gap->size);
+    }
+}
+
+// index up to `bytes` more of the text, returns 0 once all of it is indexed
+int
+Gap_index_step(struct GapBuffer* gap, ssize_t bytes)
+{
+    Gap_index_to(gap, gap->indexed + bytes);
+    return gap->indexed < gap->size;
+}
+
+int
+Gap_index_done(struct GapBuffer* gap)
+{
+    return gap->lines && gap->indexed == gap->size;
+}
+
+// index until the first `lines` lines are complete, or the text ends, and
+// return how many lines are indexed so far
+ssize_t
+Gap_index_lines(struct GapBuffer* gap, ssize_t lines)
+{
+    struct LineIndex* idx = Gap_index(gap);
+    while (Lines_count(idx) <= lines && gap->indexed < gap->size) {
+        Gap_index_to(gap, gap->indexed + INDEX_CHUNK);
+    }
+    return Lines_count(idx);
+}
+
+// account for `len` bytes of `s` about to be inserted at the cursor
+static void
+Gap_index_insert(struct GapBuffer* gap, const char* s, ssize_t len)
+{
+    struct LineIndex* idx = gap->lines;
+    Gap_index_to(gap, gap->cur_beg);
+    gap->indexed += len;
+    ssize_t col;
+    ssize_t line = Lines_find(idx, gap->cur_beg, &col);
+    ssize_t line_len = Lines_len(idx, line);
+    const char* endl = memchr(s, '\n', len);
+    if (!endl) {
+        line_len += len;
+        Lines_replace(idx, line, 1, &line_len, 1);
+        return;
+    }
+    ssize_t small[INDEX_BATCH];
+    ssize_t* lens = small;
+    ssize_t cap = INDEX_BATCH;
+    ssize_t n = 0;
+    ssize_t line_start = -col;
+    for (; endl; endl = memchr(endl + 1, '\n', s + len - endl - 1)) {
+        if (n == cap - 1) {
+            cap *= 2;
+            lens = lens == small
+                     ? memcpy(Mem_alloc(MEM_LINES, sizeof(*lens) * cap),
+                              small,
+                              sizeof(small))
+                     : Mem_realloc(MEM_LINES,
+                                   lens,
+                                   sizeof(*lens) * cap / 2,
+                                   sizeof(*lens) * cap);
+        }
+        lens[n++] = endl - s + 1 - line_start;
+        line_start = endl - s + 1;
+    }
+    lens[n++] = len - line_start + line_len - col;
+    Lines_replace(idx, line, 1, lens, n);
+    if (lens != small) {
+        Mem_free(MEM_LINES, lens, sizeof(*lens) * cap);
+    }
+}
+
+// account for `len` bytes about to be deleted after the cursor
+static void
+Gap_index_delete(struct GapBuffer* gap, ssize_t len)
+{
+    struct LineIndex* idx = gap->lines;
+    Gap_index_to(gap, gap->cur_beg + len);
+    gap->indexed -= len;
+    ssize_t col, end_col;
+    ssize_t line = Lines_find(idx, gap->cur_beg, &col);
+    ssize_t end = Lines_find(idx, gap->cur_beg + len, &end_col);
+    ssize_t line_len = col + Lines_len(idx, end) - end_col;
+    Lines_replace(idx, line, end - line + 1, &line_len, 1);
+}
+
 void
 Gap_str(struct GapBuffer* gap, char* out)
 {
@@ -29,16 +462,63 @@ Gap_str(struct GapBuffer* gap, char* out)
     out[gap->size] = '\0';
 }
 
-void
-Gap_substr(struct GapBuffer* gap, int from, int to, char* buf)
+// the text in [from, to) as at most two pieces pointing into the buffer,
+// one on each side of the gap. Returns how many pieces were filled in.
+int
+Gap_iov(struct GapBuffer* gap, ssize_t from, ssize_t to, struct iovec* iov)
 {
-    if (from >= to || from < 0) {
-        char* buf = Malloc(1);
-        buf[0] = '\0';
+    int n = 0;
+    if (to > gap->size) {
+        to = gap->size;
+    }
+    while (from < to) {
+        ssize_t avail;
+        iov[n].iov_base = (char*)Gap_at(gap, from, &avail);
+        iov[n].iov_len = avail < to - from ? avail : to - from;
+        from += iov[n].iov_len;
+        n++;
     }
+    return n;
+}
+
+#define WRITE_BATCH (MEGABYTES(8))
+
+// write the text to fd straight from the buffer, at most WRITE_BATCH bytes
+// per call. If `progress` is given it is kept up to date with the bytes
+// written so far, for other threads to read. Returns the number of bytes
+// written, or -1 with errno set.
+ssize_t
+Gap_write(struct GapBuffer* gap, int fd, ssize_t* progress)
+{
+    ssize_t off = 0;
+    while (off < gap->size) {
+        struct iovec iov[2];
+        int n = Gap_iov(gap, off, off + WRITE_BATCH, iov);
+        ssize_t written = writev(fd, iov, n);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        off += written;
+        if (progress) {
+            __atomic_store_n(progress, off, __ATOMIC_RELAXED);
+        }
+    }
+    return off;
+}
+
+void
+Gap_substr(struct GapBuffer* gap, ssize_t from, ssize_t to, char* buf)
+{
     if (to > gap->size) {
         to = gap->size;
     }
+    if (from >= to || from < 0) {
+        buf[0] = '\0';
+        return;
+    }
     ssize_t len = to - from;
     if (from + len <= gap->cur_beg) {
         memcpy(buf, gap->buf + from, len);
@@ -56,67 +536,126 @@ Gap_substr(struct GapBuffer* gap, int from, int to, char* buf)
 }
 
 void
-Gap_insert_str(struct GapBuffer* gap, char* buf)
+Gap_insert(struct GapBuffer* gap, const char* s, ssize_t len)
 {
-    size_t len = strlen(buf);
-    size_t gap_len = gap->cur_end - gap->cur_beg;
-    if (len > gap_len) {
-        gap->buf = Realloc(gap->buf, gap->size + len + GAP_SIZE + 1);
-        char* from = &gap->buf[gap->cur_end];
-        char* to = &gap->buf[gap->cur_beg + GAP_SIZE + len];
-        size_t movsize = gap->size - gap->cur_beg + 1;
-        memmove(to, from, movsize);
-        memcpy(gap->buf + gap->cur_beg, buf, len);
-        gap->cur_beg += len;
-        gap->cur_end = gap->cur_beg + GAP_SIZE;
-        gap->size += len;
-    } else {
-        memcpy(gap->buf + gap->cur_beg, buf, len);
-        gap->cur_beg += len;
-        gap->size += len;
+    if (gap->lines) {
+        Gap_index_insert(gap, s, len);
     }
+    Gap_reserve(gap, len);
+    Gap_touch(gap, gap->cur_beg, gap->cur_beg + len);
+    memcpy(gap->buf + gap->cur_beg, s, len);
+    gap->cur_beg += len;
+    gap->size += len;
+    gap->edits++;
 }
 
 void
-Gap_insert_chr(struct GapBuffer* gap, char c)
+Gap_insert_str(struct GapBuffer* gap, char* buf)
 {
+    Gap_insert(gap, buf, strlen(buf));
+}
 
-    if (!(gap->cur_end - gap->cur_beg)) {
-        gap->buf = Realloc(gap->buf, gap->size + GAP_SIZE + 1);
-        char* from = &gap->buf[gap->cur_end];
-        char* to = &gap->buf[gap->cur_end + GAP_SIZE];
-        memmove(to, from, gap->size - gap->cur_beg + 1);
-        gap->cur_end += GAP_SIZE;
+void
+Gap_insert_chr(struct GapBuffer* gap, char c)
+{
+    if (gap->lines) {
+        Gap_index_insert(gap, &c, 1);
     }
+    Gap_reserve(gap, 1);
+    Gap_touch(gap, gap->cur_beg, gap->cur_beg + 1);
     gap->buf[gap->cur_beg] = c;
     gap->cur_beg++;
     gap->size++;
+    gap->edits++;
+}
+
+// shortest gap move worth remapping pages for
+#define REMAP_MIN (MEGABYTES(1))
+
+// move the `len` bytes of text at `at` by `by`, the length of the gap, to
+// the other side of it. In a mapping whose gap is a whole number of pages
+// the whole pages in between are remapped rather than copied, so they are
+// neither read from the file nor copied on write. The gap of a mapping
+// starts out so, and the first jump into it is a few system calls however
+// far it goes.
+static void
+Gap_shift(struct GapBuffer* gap, ssize_t at, ssize_t len, ssize_t by)
+{
+    char* buf = gap->buf;
+    ssize_t page = sysconf(_SC_PAGESIZE);
+    ssize_t gap_len = by < 0 ? -by : by;
+    if (!gap->mapped || gap->shared || gap_len % page || len < REMAP_MIN) {
+        memmove(&buf[at + by], &buf[at], len);
+        return;
+    }
+    // the whole pages of the text are [lo, hi). They are remapped in steps
+    // no longer than the gap, so no step lands on text yet to be moved, and
+    // the gap they leave behind is mapped afresh.
+    ssize_t lo = (at + page - 1) / page * page;
+    ssize_t hi = (at + len) / page * page;
+    int flags = MREMAP_MAYMOVE | MREMAP_FIXED;
+    if (by < 0) {
+        memmove(&buf[at + by], &buf[at], lo - at);
+        for (ssize_t p = lo; p < hi; p += gap_len) {
+            ssize_t n = hi - p < gap_len ? hi - p : gap_len;
+            if (mremap(&buf[p], n, n, flags, &buf[p + by]) == MAP_FAILED) {
+                unix_error("mremap");
+            }
+        }
+    } else {
+        memmove(&buf[hi + by], &buf[hi], at + len - hi);
+        for (ssize_t p = hi; p > lo; p -= gap_len) {
+            ssize_t n = p - lo < gap_len ? p - lo : gap_len;
+            if (mremap(&buf[p - n], n, n, flags, &buf[p - n + by]) ==
+                MAP_FAILED) {
+                unix_error("mremap");
+            }
+        }
+    }
+    char* left = by < 0 ? &buf[hi + by] : &buf[lo];
+    if (mmap(left,
+             gap_len,
+             PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+             -1,
+             0) == MAP_FAILED) {
+        unix_error("mmap");
+    }
+    if (by < 0) {
+        memmove(&buf[hi + by], &buf[hi], at + len - hi);
+    } else {
+        memmove(&buf[at + by], &buf[at], lo - at);
+    }
 }
 
+// Move the gap `steps` bytes. Unlike a piece table, this copies the text
+// between the old and new place, so an edit costs O(log n) for the line
+// index plus O(distance) from the last edit. The cursor moves without the
+// gap, so that is paid once per jump rather than per edit, and a mapping's
+// first jump remaps pages instead, see Gap_shift.
 void
-Gap_mov(struct GapBuffer* gap, int steps)
+Gap_mov(struct GapBuffer* gap, ssize_t steps)
 {
     if (steps > 0) {
         if (gap->cur_beg + steps > gap->size) {
             steps = gap->size - gap->cur_beg;
         }
-        char* from = &gap->buf[gap->cur_end];
-        char* to = &gap->buf[gap->cur_beg];
-        memmove(to, from, steps);
+        Gap_touch(gap, gap->cur_beg, gap->cur_beg + steps);
+        Gap_shift(gap, gap->cur_end, steps, gap->cur_beg - gap->cur_end);
     } else {
         if (gap->cur_beg < -steps) {
             steps = -gap->cur_beg;
         }
-        char* from = &gap->buf[gap->cur_beg + steps];
-        char* to = &gap->buf[gap->cur_end + steps];
-        memmove(to, from, -steps);
+        Gap_touch(gap, gap->cur_end + steps, gap->cur_end);
+        Gap_shift(
+          gap, gap->cur_beg + steps, -steps, gap->cur_end - gap->cur_beg);
     }
     gap->cur_beg += steps;
     gap->cur_end += steps;
 }
 
 void
-Gap_del(struct GapBuffer* gap, int steps)
+Gap_del(struct GapBuffer* gap, ssize_t steps)
 {
     if (gap->cur_beg >= gap->size) {
         return;
@@ -124,50 +663,199 @@ Gap_del(struct GapBuffer* gap, int steps)
     if (steps > gap->size - gap->cur_beg) {
         steps = gap->size - gap->cur_beg;
     }
+    if (gap->lines) {
+        Gap_index_delete(gap, steps);
+    }
     gap->size -= steps;
+    gap->edits++;
     gap->cur_end += steps;
 }
 
+// give back memory held by a gap that has grown far beyond what the policy
+// would open for the current size, e.g. after deleting a large region.
+// Meant to be called when the editor is idle, not on every edit.
 void
-Gap_nextline(struct GapBuffer* gap)
+Gap_shrink(struct GapBuffer* gap)
 {
-    ssize_t xpos = 0;
-    if (gap->cur_beg) {
-        for (size_t i = gap->cur_beg - 1; i && gap->buf[i] != '\n'; i--) {
-            xpos++;
+    ssize_t target = Gap_target(gap->size);
+    ssize_t gap_len = gap->cur_end - gap->cur_beg;
+    if (!gap->mapped && !gap->shared &&
+        gap_len > target * policy.shrink_mul) {
+        Gap_resize(gap, target);
+    }
+}
+
+// copy [from, to) of the text to `out`, without a terminator
+static void
+Gap_copy_out(struct GapBuffer* gap, ssize_t from, ssize_t to, char* out)
+{
+    while (from < to) {
+        ssize_t avail;
+        const char* p = Gap_at(gap, from, &avail);
+        if (avail > to - from) {
+            avail = to - from;
         }
+        memcpy(out, p, avail);
+        out += avail;
+        from += avail;
     }
+}
 
-    char* endl = strchr(&gap->buf[gap->cur_end], '\n');
-    if (endl) {
-        char* nendl = strchr(endl + 1, '\n');
-        if (nendl) {
-            // clamp to next endl
-            xpos = nendl - endl - 1 < xpos ? nendl - endl - 1 : xpos;
-            Gap_mov(gap, endl - &gap->buf[gap->cur_end] + 1 + xpos);
-        } else {
-            // past end of line would mean past end of buffer
-            // which is clamped by the Gap_mov implementation
-            Gap_mov(gap, endl - &gap->buf[gap->cur_end] + 1 + xpos);
+// the text in [from, to) with the edits that lie in it, written to `out`
+struct SpliceSlice
+{
+    struct GapBuffer* gap;
+    const struct GapEdit* edits;
+    ssize_t n;
+    ssize_t from, to;
+    char* out;
+};
+
+static void
+Gap_splice_slice(void* arg, int job)
+{
+    struct SpliceSlice* slice = &((struct SpliceSlice*)arg)[job];
+    char* out = slice->out;
+    ssize_t at = slice->from;
+    for (ssize_t i = 0; i < slice->n; i++) {
+        const struct GapEdit* edit = &slice->edits[i];
+        Gap_copy_out(slice->gap, at, edit->at, out);
+        out += edit->at - at;
+        memcpy(out, edit->with, edit->with_len);
+        out += edit->with_len;
+        at = edit->at + edit->len;
+    }
+    Gap_copy_out(slice->gap, at, slice->to, out);
+}
+
+// Make all of the `n` edits, which are in order and do not overlap, in one
+// pass: the new text is copied into a fresh buffer, in slices on the
+// worker pool when the text is large. The gap opens at the start and the
+// line index is dropped, to be built again as it is needed.
+void
+Gap_splice(struct GapBuffer* gap, const struct GapEdit* edits, ssize_t n)
+{
+    ssize_t size = gap->size;
+    for (ssize_t i = 0; i < n; i++) {
+        size += edits[i].with_len - edits[i].len;
+    }
+    ssize_t gap_len = Gap_target(size);
+    char* buf = Mem_alloc(MEM_TEXT, size + gap_len + 1);
+    int jobs = 1;
+    if (workers && Work_threads(workers) > 1 &&
+        gap->size >= 2 * INDEX_SLICE) {
+        jobs = Work_threads(workers) * 4;
+    }
+    struct SpliceSlice* slices =
+      Mem_alloc(MEM_SCRATCH, sizeof(struct SpliceSlice) * jobs);
+    // cut the old text into even slices, moving a cut that falls inside an
+    // edit to its end
+    ssize_t from = 0;
+    ssize_t shift = 0;
+    ssize_t e = 0;
+    for (int job = 0; job < jobs; job++) {
+        struct SpliceSlice* slice = &slices[job];
+        ssize_t to = job + 1 == jobs ? gap->size : gap->size / jobs * (job + 1);
+        to = to < from ? from : to;
+        slice->gap = gap;
+        slice->edits = &edits[e];
+        slice->from = from;
+        slice->out = &buf[gap_len + from + shift];
+        for (; e < n && (edits[e].at < to || job + 1 == jobs); e++) {
+            if (edits[e].at + edits[e].len > to) {
+                to = edits[e].at + edits[e].len;
+            }
+            shift += edits[e].with_len - edits[e].len;
         }
+        slice->n = &edits[e] - slice->edits;
+        slice->to = to;
+        from = to;
+    }
+    if (jobs > 1) {
+        Work_run(workers, Gap_splice_slice, slices, jobs);
+    } else {
+        Gap_splice_slice(slices, 0);
+    }
+    Mem_free(MEM_SCRATCH, slices, sizeof(struct SpliceSlice) * jobs);
+    Gap_drop_buf(gap);
+    if (gap->lines) {
+        Lines_free(gap->lines);
+        gap->lines = NULL;
     }
+    gap->buf = buf;
+    gap->size = size;
+    gap->capacity = size + gap_len;
+    gap->cur_beg = 0;
+    gap->cur_end = gap_len;
+    gap->buf[gap->capacity] = '\0';
+    gap->indexed = 0;
+    gap->edits++;
+}
+
+// number of lines in the text, indexing all of it if needed
+ssize_t
+Gap_lines(struct GapBuffer* gap)
+{
+    Gap_index_to(gap, gap->size);
+    return Lines_count(gap->lines);
+}
+
+ssize_t
+Gap_line_start(struct GapBuffer* gap, ssize_t line)
+{
+    Gap_index_lines(gap, line);
+    return Lines_start(gap->lines, line);
+}
+
+// length of a line without its newline
+ssize_t
+Gap_line_len(struct GapBuffer* gap, ssize_t line)
+{
+    ssize_t count = Gap_index_lines(gap, line + 1);
+    ssize_t len = Lines_len(gap->lines, line);
+    return line < count - 1 ? len - 1 : len;
+}
+
+ssize_t
+Gap_line_of(struct GapBuffer* gap, ssize_t offset, ssize_t* col)
+{
+    Gap_index_to(gap, offset);
+    return Lines_find(gap->lines, offset, col);
 }
 
+// move the cursor to `col` on `line`, clamped to the text
 void
-Gap_prevline(struct GapBuffer* gap)
+Gap_goto_line(struct GapBuffer* gap, ssize_t line, ssize_t col)
 {
-    size_t xpos = 0;
-    while (gap->cur_beg && gap->buf[gap->cur_beg] != '\n') {
-        Gap_mov(gap, -1);
-        xpos++;
+    ssize_t last = Gap_index_lines(gap, line + 1) - 1;
+    if (line > last) {
+        line = last;
+    } else if (line < 0) {
+        line = 0;
+    }
+    ssize_t len = Gap_line_len(gap, line);
+    if (col > len) {
+        col = len;
     }
-    size_t line_len = 0;
-    size_t line_start;
-    for (line_start = gap->cur_beg - 1;
-         line_start && gap->buf[line_start] != '\n';
-         line_start--) {
-        line_len++;
+    Gap_mov(gap, Gap_line_start(gap, line) + col - gap->cur_beg);
+}
+
+void
+Gap_nextline(struct GapBuffer* gap)
+{
+    ssize_t col;
+    ssize_t line = Gap_line_of(gap, gap->cur_beg, &col);
+    if (line + 1 < Gap_index_lines(gap, line + 1)) {
+        Gap_goto_line(gap, line + 1, col);
+    }
+}
+
+void
+Gap_prevline(struct GapBuffer* gap)
+{
+    ssize_t col;
+    ssize_t line = Gap_line_of(gap, gap->cur_beg, &col);
+    if (line > 0) {
+        Gap_goto_line(gap, line - 1, col);
     }
-    xpos = line_len > xpos ? xpos : line_len;
-    Gap_mov(gap, line_start - gap->cur_beg + xpos - 1);
 }
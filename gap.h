@@ -1,23 +1,93 @@
 #ifndef GAP_BUFFER
 #define GAP_BUFFER
 #include <stdlib.h>
+#include <sys/types.h>
+
+struct BumpAlloc;
+struct LineIndex;
+struct WorkPool;
+struct iovec;
 
 struct GapBuffer
 {
-    ssize_t size;
+    ssize_t size;     // bytes of text, not counting the gap
+    ssize_t capacity; // size plus the gap, excluding the '\0' terminator
     ssize_t cur_beg;
     ssize_t cur_end;
     char* buf;
+    size_t mapped;            // length of the mapping if buf is mmapped
+    struct LineIndex* lines;  // built on first use, then kept up to date
+    ssize_t indexed;          // newlines before this offset are indexed
+    struct GapBuffer* shared; // the other side sharing buf, see Gap_snapshot
+    size_t edits;             // bumped by every change to the text
+};
+
+// one edit of a Gap_splice: the `len` bytes at `at` become the `with_len`
+// bytes at `with`
+struct GapEdit
+{
+    ssize_t at;
+    ssize_t len;
+    const char* with;
+    ssize_t with_len;
 };
 
+// how the gap is resized. When an insert does not fit, the gap is reopened
+// to size * grow_pct / 100 bytes, clamped to [min_gap, max_gap] but never
+// smaller than the insert. Gap_shrink gives memory back once the gap is
+// more than shrink_mul times what the policy would open for the current size.
+struct GapPolicy
+{
+    ssize_t min_gap;
+    ssize_t max_gap;
+    int grow_pct;
+    int shrink_mul;
+};
+
+void
+Gap_set_policy(const struct GapPolicy* policy);
+
+void
+Gap_get_policy(struct GapPolicy* policy);
+
 struct GapBuffer*
 Gap_new(char* buf);
 
+void
+Gap_set_workers(struct WorkPool* pool);
+
+struct GapBuffer*
+Gap_map(int fd, ssize_t size);
+
+void
+Gap_unmap(struct GapBuffer* gap);
+
+struct GapBuffer*
+Gap_snapshot(struct GapBuffer* gap, struct BumpAlloc* arena);
+
+void
+Gap_release(struct GapBuffer* snapshot);
+
+size_t
+Gap_unshared(size_t* bytes);
+
+void
+Gap_free(struct GapBuffer* gap);
+
 void
 Gap_str(struct GapBuffer* gap, char* out);
 
+int
+Gap_iov(struct GapBuffer* gap, ssize_t from, ssize_t to, struct iovec* iov);
+
+ssize_t
+Gap_write(struct GapBuffer* gap, int fd, ssize_t* progress);
+
 void
-Gap_substr(struct GapBuffer* gap, int from, int to, char* out);
+Gap_substr(struct GapBuffer* gap, ssize_t from, ssize_t to, char* out);
+
+void
+Gap_insert(struct GapBuffer* gap, const char* s, ssize_t len);
 
 void
 Gap_insert_str(struct GapBuffer* gap, char* buf);
@@ -26,10 +96,40 @@ void
 Gap_insert_chr(struct GapBuffer* gap, char c);
 
 void
-Gap_mov(struct GapBuffer* gap, int steps);
+Gap_mov(struct GapBuffer* gap, ssize_t steps);
+
+void
+Gap_del(struct GapBuffer* gap, ssize_t chars);
+
+void
+Gap_shrink(struct GapBuffer* gap);
+
+void
+Gap_splice(struct GapBuffer* gap, const struct GapEdit* edits, ssize_t n);
+
+int
+Gap_index_step(struct GapBuffer* gap, ssize_t bytes);
+
+int
+Gap_index_done(struct GapBuffer* gap);
+
+ssize_t
+Gap_index_lines(struct GapBuffer* gap, ssize_t lines);
+
+ssize_t
+Gap_lines(struct GapBuffer* gap);
+
+ssize_t
+Gap_line_start(struct GapBuffer* gap, ssize_t line);
+
+ssize_t
+Gap_line_len(struct GapBuffer* gap, ssize_t line);
+
+ssize_t
+Gap_line_of(struct GapBuffer* gap, ssize_t offset, ssize_t* col);
 
 void
-Gap_del(struct GapBuffer* gap, int chars);
+Gap_goto_line(struct GapBuffer* gap, ssize_t line, ssize_t col);
 
 void
 Gap_nextline(struct GapBuffer* gap);
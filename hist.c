@@ -0,0 +1,109 @@
+#include "hist.h"
+#include <string.h>
+#include <time.h>
+
+static int
+bucket_of(uint64_t value)
+{
+    if (value < HIST_SUB) {
+        return value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) +
+           ((value >> shift) & (HIST_SUB - 1));
+}
+
+// smallest value counted in bucket `i`
+static uint64_t
+bucket_value(int i)
+{
+    if (i < HIST_SUB) {
+        return i;
+    }
+    int shift = (i >> HIST_SUB_BITS) - 1;
+    return (uint64_t)(HIST_SUB + (i & (HIST_SUB - 1))) << shift;
+}
+
+void
+Hist_init(struct Hist* h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void
+Hist_record(struct Hist* h, uint64_t value)
+{
+    h->buckets[bucket_of(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+// the value below which `pct` percent of the recorded values fall, to
+// within the precision of a bucket
+uint64_t
+Hist_percentile(struct Hist* h, double pct)
+{
+    if (!h->count) {
+        return 0;
+    }
+    uint64_t rank = pct / 100 * h->count;
+    if (rank >= h->count) {
+        return h->max;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen > rank) {
+            uint64_t value = bucket_value(i);
+            return value < h->min ? h->min : value;
+        }
+    }
+    return h->max;
+}
+
+// write a summary line and the non-empty buckets, with values divided by
+// `unit`
+void
+Hist_dump(struct Hist* h, const char* name, double unit, FILE* out)
+{
+    fprintf(out,
+            "%s: count %lu mean %.3f min %.3f p50 %.3f p90 %.3f p99 %.3f "
+            "p99.9 %.3f max %.3f\n",
+            name,
+            (unsigned long)h->count,
+            h->count ? h->sum / unit / h->count : 0,
+            h->count ? h->min / unit : 0,
+            Hist_percentile(h, 50) / unit,
+            Hist_percentile(h, 90) / unit,
+            Hist_percentile(h, 99) / unit,
+            Hist_percentile(h, 99.9) / unit,
+            h->max / unit);
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        if (h->buckets[i]) {
+            seen += h->buckets[i];
+            fprintf(out,
+                    "  %12.3f %10lu %8.4f\n",
+                    bucket_value(i) / unit,
+                    (unsigned long)h->buckets[i],
+                    (double)seen / h->count);
+        }
+    }
+}
+
+// monotonic time in ns
+uint64_t
+Hist_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
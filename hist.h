@@ -0,0 +1,38 @@
+#ifndef HIST
+#define HIST
+#include <stdint.h>
+#include <stdio.h>
+
+// sub-buckets per power of two, as a power of two. 5 keeps every recorded
+// value within about 3% of its bucket.
+#define HIST_SUB_BITS (5)
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+// A log-linear histogram in the style of HdrHistogram: values below
+// HIST_SUB are counted exactly, larger ones in HIST_SUB buckets per power
+// of two. Recording is a few instructions and the size is fixed.
+struct Hist
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+};
+
+void
+Hist_init(struct Hist* h);
+
+void
+Hist_record(struct Hist* h, uint64_t value);
+
+uint64_t
+Hist_percentile(struct Hist* h, double pct);
+
+void
+Hist_dump(struct Hist* h, const char* name, double unit, FILE* out);
+
+uint64_t
+Hist_now(void);
+#endif // !HIST
@@ -0,0 +1,365 @@
+#include "lines.h"
+#include "mem.h"
+#include "util.h"
+#include <string.h>
+
+// blocks built in bulk are left partly empty so that the next few inserted
+// lines fit without splitting
+#define BUILD_FILL (LINES_BLOCK * 3 / 4)
+
+static ssize_t
+tree_lines(struct LineBlock* t)
+{
+    return t ? t->tree_lines : 0;
+}
+
+static ssize_t
+tree_bytes(struct LineBlock* t)
+{
+    return t ? t->tree_bytes : 0;
+}
+
+static void
+update(struct LineBlock* t)
+{
+    t->tree_lines = tree_lines(t->left) + t->n + tree_lines(t->right);
+    t->tree_bytes = tree_bytes(t->left) + t->bytes + tree_bytes(t->right);
+}
+
+static unsigned
+next_prio(struct LineIndex* idx)
+{
+    // xorshift32
+    unsigned x = idx->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    idx->seed = x;
+    return x;
+}
+
+static struct LineBlock*
+block_new(struct LineIndex* idx, const ssize_t* lens, int n)
+{
+    struct LineBlock* b = Pool_alloc(idx->pool);
+    b->left = NULL;
+    b->right = NULL;
+    b->prio = next_prio(idx);
+    b->n = n;
+    b->bytes = 0;
+    for (int i = 0; i < n; i++) {
+        b->len[i] = lens[i];
+        b->bytes += lens[i];
+    }
+    update(b);
+    return b;
+}
+
+static void
+tree_free(struct LineIndex* idx, struct LineBlock* t)
+{
+    if (!t) {
+        return;
+    }
+    tree_free(idx, t->left);
+    tree_free(idx, t->right);
+    Pool_free(idx->pool, t);
+}
+
+static struct LineBlock*
+merge(struct LineBlock* a, struct LineBlock* b)
+{
+    if (!a) {
+        return b;
+    } else if (!b) {
+        return a;
+    } else if (a->prio > b->prio) {
+        a->right = merge(a->right, b);
+        update(a);
+        return a;
+    } else {
+        b->left = merge(a, b->left);
+        update(b);
+        return b;
+    }
+}
+
+// split t so that the first k lines end up in *l and the rest in *r,
+// cutting a block in two if k falls inside it
+static void
+split(struct LineIndex* idx,
+      struct LineBlock* t,
+      ssize_t k,
+      struct LineBlock** l,
+      struct LineBlock** r)
+{
+    if (!t) {
+        *l = *r = NULL;
+        return;
+    }
+    ssize_t left_lines = tree_lines(t->left);
+    if (k <= left_lines) {
+        split(idx, t->left, k, l, &t->left);
+        update(t);
+        *r = t;
+    } else if (k >= left_lines + t->n) {
+        split(idx, t->right, k - left_lines - t->n, &t->right, r);
+        update(t);
+        *l = t;
+    } else {
+        int at = k - left_lines;
+        struct LineBlock* tail = block_new(idx, &t->len[at], t->n - at);
+        struct LineBlock* right = t->right;
+        t->n = at;
+        t->bytes -= tail->bytes;
+        t->right = NULL;
+        update(t);
+        *l = t;
+        *r = merge(tail, right);
+    }
+}
+
+// replace lines inside a single block without restructuring the tree.
+// Returns 0 if the change does not fit in the block holding `line`.
+static int
+replace_in_block(struct LineBlock* t,
+                 ssize_t line,
+                 ssize_t count,
+                 const ssize_t* lens,
+                 ssize_t n)
+{
+    if (!t) {
+        return 0;
+    }
+    ssize_t left_lines = tree_lines(t->left);
+    int done;
+    if (line < left_lines) {
+        done = line + count <= left_lines &&
+               replace_in_block(t->left, line, count, lens, n);
+    } else if (line < left_lines + t->n) {
+        ssize_t at = line - left_lines;
+        ssize_t new_n = t->n - count + n;
+        done = at + count <= t->n && new_n > 0 && new_n <= LINES_BLOCK;
+        if (done) {
+            for (ssize_t i = at; i < at + count; i++) {
+                t->bytes -= t->len[i];
+            }
+            memmove(&t->len[at + n],
+                    &t->len[at + count],
+                    sizeof(*t->len) * (t->n - at - count));
+            for (ssize_t i = 0; i < n; i++) {
+                t->len[at + i] = lens[i];
+                t->bytes += lens[i];
+            }
+            t->n = new_n;
+        }
+    } else {
+        done = replace_in_block(
+          t->right, line - left_lines - t->n, count, lens, n);
+    }
+    if (done) {
+        update(t);
+    }
+    return done;
+}
+
+static struct LineBlock*
+build(struct LineIndex* idx, const ssize_t* lens, ssize_t n)
+{
+    struct LineBlock* t = NULL;
+    for (ssize_t i = 0; i < n; i += BUILD_FILL) {
+        int count = n - i < BUILD_FILL ? n - i : BUILD_FILL;
+        t = merge(t, block_new(idx, &lens[i], count));
+    }
+    return t;
+}
+
+struct LineIndex*
+Lines_new(void)
+{
+    static unsigned seed = 2463534242u;
+    struct LineIndex* idx = Mem_alloc(MEM_LINES, sizeof(*idx));
+    idx->pool = Pool_new(LINES_SLAB, sizeof(struct LineBlock), MEM_LINES);
+    idx->seed = __atomic_add_fetch(&seed, 0x9e3779b9u, __ATOMIC_RELAXED);
+    ssize_t empty = 0;
+    idx->root = block_new(idx, &empty, 1);
+    return idx;
+}
+
+void
+Lines_free(struct LineIndex* idx)
+{
+    // every block is in the pool, so the tree need not be walked
+    Pool_delete(idx->pool);
+    Mem_free(MEM_LINES, idx, sizeof(*idx));
+}
+
+ssize_t
+Lines_count(struct LineIndex* idx)
+{
+    return tree_lines(idx->root);
+}
+
+ssize_t
+Lines_bytes(struct LineIndex* idx)
+{
+    return tree_bytes(idx->root);
+}
+
+// offset of the first byte of `line`, or the total size past the last line
+ssize_t
+Lines_start(struct LineIndex* idx, ssize_t line)
+{
+    ssize_t offset = 0;
+    struct LineBlock* t = idx->root;
+    while (t) {
+        ssize_t left_lines = tree_lines(t->left);
+        if (line < left_lines) {
+            t = t->left;
+            continue;
+        }
+        offset += tree_bytes(t->left);
+        line -= left_lines;
+        if (line < t->n) {
+            for (ssize_t i = 0; i < line; i++) {
+                offset += t->len[i];
+            }
+            return offset;
+        }
+        offset += t->bytes;
+        line -= t->n;
+        t = t->right;
+    }
+    return offset;
+}
+
+// length of `line` including its newline, 0 past the last line
+ssize_t
+Lines_len(struct LineIndex* idx, ssize_t line)
+{
+    struct LineBlock* t = idx->root;
+    while (t) {
+        ssize_t left_lines = tree_lines(t->left);
+        if (line < left_lines) {
+            t = t->left;
+        } else if (line < left_lines + t->n) {
+            return t->len[line - left_lines];
+        } else {
+            line -= left_lines + t->n;
+            t = t->right;
+        }
+    }
+    return 0;
+}
+
+// line holding the byte at `offset` and the column of that byte within it.
+// Offsets at or past the end of the text map to the end of the last line.
+ssize_t
+Lines_find(struct LineIndex* idx, ssize_t offset, ssize_t* col)
+{
+    ssize_t total = Lines_bytes(idx);
+    if (offset >= total) {
+        ssize_t last = Lines_count(idx) - 1;
+        *col = offset - total + Lines_len(idx, last);
+        return last;
+    }
+    ssize_t line = 0;
+    struct LineBlock* t = idx->root;
+    while (t) {
+        ssize_t left_bytes = tree_bytes(t->left);
+        if (offset < left_bytes) {
+            t = t->left;
+            continue;
+        }
+        offset -= left_bytes;
+        line += tree_lines(t->left);
+        if (offset < t->bytes) {
+            int i = 0;
+            while (offset >= t->len[i]) {
+                offset -= t->len[i];
+                i++;
+            }
+            *col = offset;
+            return line + i;
+        }
+        offset -= t->bytes;
+        line += t->n;
+        t = t->right;
+    }
+    // unreachable: offset < total
+    *col = 0;
+    return 0;
+}
+
+// replace the `count` lines starting at `line` with `n` lines of the given
+// lengths. Edits that stay inside one block are done in place, anything
+// else splits the affected range out of the tree and merges in new blocks.
+void
+Lines_replace(struct LineIndex* idx,
+              ssize_t line,
+              ssize_t count,
+              const ssize_t* lens,
+              ssize_t n)
+{
+    if (replace_in_block(idx->root, line, count, lens, n)) {
+        return;
+    }
+    struct LineBlock *before, *rest, *old, *after;
+    split(idx, idx->root, line, &before, &rest);
+    split(idx, rest, count, &old, &after);
+    tree_free(idx, old);
+    idx->root = merge(merge(before, build(idx, lens, n)), after);
+}
+
+// add `delta` bytes to the last line
+void
+Lines_extend(struct LineIndex* idx, ssize_t delta)
+{
+    ssize_t last = Lines_count(idx) - 1;
+    ssize_t len = Lines_len(idx, last) + delta;
+    Lines_replace(idx, last, 1, &len, 1);
+}
+
+#define APPEND_BATCH (1024)
+
+// index `len` more bytes of text: they continue the last line, and every
+// newline among them starts a new one
+void
+Lines_append(struct LineIndex* idx, const char* text, ssize_t len)
+{
+    ssize_t lens[APPEND_BATCH];
+    ssize_t n = 0;
+    ssize_t last = Lines_count(idx) - 1;
+    ssize_t line_len = Lines_len(idx, last);
+    const char* end = text + len;
+    const char* endl;
+    while ((endl = memchr(text, '\n', end - text))) {
+        lens[n++] = line_len + endl - text + 1;
+        line_len = 0;
+        text = endl + 1;
+        if (n == APPEND_BATCH - 1) {
+            lens[n++] = 0;
+            Lines_replace(idx, last, 1, lens, n);
+            last += n - 1;
+            n = 0;
+        }
+    }
+    lens[n++] = line_len + end - text;
+    Lines_replace(idx, last, 1, lens, n);
+}
+
+// append the lines of `tail` to `idx`, joining the first line of `tail` to
+// the last line of `idx`. `tail` is consumed.
+void
+Lines_concat(struct LineIndex* idx, struct LineIndex* tail)
+{
+    ssize_t last = Lines_count(idx) - 1;
+    ssize_t joined = Lines_len(idx, last) + Lines_len(tail, 0);
+    Lines_replace(tail, 0, 1, &joined, 1);
+    struct LineBlock *before, *old;
+    split(idx, idx->root, last, &before, &old);
+    tree_free(idx, old);
+    idx->root = merge(before, tail->root);
+    Pool_merge(idx->pool, tail->pool);
+    Mem_free(MEM_LINES, tail, sizeof(*tail));
+}
@@ -0,0 +1,74 @@
+#ifndef LINE_INDEX
+#define LINE_INDEX
+#include <stdlib.h>
+#include <sys/types.h>
+
+// lines per block. Blocks are the nodes of the index, so a block holds the
+// lengths of a run of consecutive lines.
+#define LINES_BLOCK (128)
+
+// blocks in the first slab of an index's pool
+#define LINES_SLAB (4)
+
+struct MemoryPool;
+
+struct LineBlock
+{
+    struct LineBlock* left;
+    struct LineBlock* right;
+    unsigned prio;
+    int n;
+    ssize_t bytes;
+    ssize_t tree_lines;
+    ssize_t tree_bytes;
+    ssize_t len[LINES_BLOCK];
+};
+
+// Line lengths kept in a treap of blocks, ordered by position in the text.
+// A line's length includes its '\n', so the lengths sum to the size of the
+// text and the last line is the only one without a newline. Every lookup
+// is O(log n) in the number of lines.
+struct LineIndex
+{
+    struct LineBlock* root;
+    unsigned seed;
+    struct MemoryPool* pool; // the blocks of this index
+};
+
+struct LineIndex*
+Lines_new(void);
+
+void
+Lines_free(struct LineIndex* idx);
+
+ssize_t
+Lines_count(struct LineIndex* idx);
+
+ssize_t
+Lines_bytes(struct LineIndex* idx);
+
+ssize_t
+Lines_start(struct LineIndex* idx, ssize_t line);
+
+ssize_t
+Lines_len(struct LineIndex* idx, ssize_t line);
+
+ssize_t
+Lines_find(struct LineIndex* idx, ssize_t offset, ssize_t* col);
+
+void
+Lines_replace(struct LineIndex* idx,
+              ssize_t line,
+              ssize_t count,
+              const ssize_t* lens,
+              ssize_t n);
+
+void
+Lines_extend(struct LineIndex* idx, ssize_t delta);
+
+void
+Lines_append(struct LineIndex* idx, const char* text, ssize_t len);
+
+void
+Lines_concat(struct LineIndex* idx, struct LineIndex* tail);
+#endif // !LINE_INDEX
@@ -1,20 +1,33 @@
 
+#include "batch.h"
+#include "event.h"
+#include "frame.h"
 #include "gap.h"
 #include "mem.h"
 #include "texter.h"
+#include "undo.h"
 #include "util.h"
+#include "work.h"
+#include <getopt.h>
+#include <string.h>
 #include <unistd.h>
 
 struct GlobalState
 {
     struct termios orig_termios;
+    struct EditorContext* ctx;
+    const char* latency_file;
 };
 
 static struct GlobalState G;
 
+#define PASTE_ON ("\x1b[?2004h")
+#define PASTE_OFF ("\x1b[?2004l")
+
 void
 disable_raw_mode(void)
 {
+    write(STDOUT_FILENO, PASTE_OFF, strlen(PASTE_OFF));
     Tcsetattr(STDIN_FILENO, TCSAFLUSH, &G.orig_termios);
 }
 
@@ -24,31 +37,177 @@ enable_raw_mode(void)
     struct termios raw;
     Tcgetattr(STDIN_FILENO, &G.orig_termios);
     cfmakeraw(&raw);
+    // reads never block, the event loop waits for input instead
     raw.c_cc[VMIN] = 0;
-    raw.c_cc[VTIME] = 1;
+    raw.c_cc[VTIME] = 0;
     Tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+    // pastes arrive between markers, see enter_paste
+    write(STDOUT_FILENO, PASTE_ON, strlen(PASTE_ON));
+}
+
+// printed once the terminal is back to normal
+void
+report_stats(void)
+{
+    if (!G.ctx) {
+        return;
+    }
+    struct Frame* frame = G.ctx->frame;
+    fprintf(stderr,
+            "frames: %zu, bytes written: %zu, bytes per frame: %zu\n",
+            frame->frames,
+            frame->total_bytes,
+            frame->frames ? frame->total_bytes / frame->frames : 0);
+    size_t copied;
+    size_t copies = Gap_unshared(&copied);
+    fprintf(stderr,
+            "save snapshot copies: %zu, bytes copied: %zu\n",
+            copies,
+            copied);
+    fprintf(stderr, "%-8s %14s %14s\n", "memory", "live", "peak");
+    for (int tag = 0; tag < MEM_TAGS; tag++) {
+        fprintf(stderr,
+                "%-8s %14zu %14zu\n",
+                Mem_name(tag),
+                Mem_live(tag),
+                Mem_peak(tag));
+    }
+}
+
+void
+dump_latency(void)
+{
+    if (!G.ctx) {
+        return;
+    }
+    FILE* out = fopen(G.latency_file, "w");
+    if (!out) {
+        perror(G.latency_file);
+        return;
+    }
+    struct Latency* lat = G.ctx->latency;
+    Hist_dump(&lat->total, "key to paint (ms)", 1e6, out);
+    Hist_dump(&lat->handle, "handle input (ms)", 1e6, out);
+    Hist_dump(&lat->render, "render (ms)", 1e6, out);
+    Hist_dump(&lat->write, "write (ms)", 1e6, out);
+    Hist_dump(&lat->bytes, "bytes per frame", 1, out);
+    Hist_dump(&lat->save, "save start (ms)", 1e6, out);
+    fclose(out);
+}
+
+void
+usage(char* prog)
+{
+    fprintf(stderr,
+            "usage: %s [--threads N] [--autosave SECONDS] [--stats] "
+            "[--latency FILE] [--undo-limit MB] [--batch SCRIPT] [file]\n",
+            prog);
+    exit(EXIT_FAILURE);
 }
 
 int
 main(int argc, char* argv[])
 {
-    struct BumpAlloc* bmp = Bump_new(MEGABYTES((size_t)2));
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int autosave = 0;
+    int stats = 0;
+    int undo_limit = 0;
+    const char* script = NULL;
+    const struct option options[] = {
+        { "threads", required_argument, NULL, 't' },
+        { "autosave", required_argument, NULL, 'a' },
+        { "stats", no_argument, NULL, 's' },
+        { "latency", required_argument, NULL, 'l' },
+        { "undo-limit", required_argument, NULL, 'u' },
+        { "batch", required_argument, NULL, 'b' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:a:sl:u:b:", options, NULL)) !=
+           -1) {
+        switch (opt) {
+            case 't':
+                threads = atoi(optarg);
+                if (threads < 1) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'a':
+                autosave = atoi(optarg);
+                if (autosave < 1) {
+                    usage(argv[0]);
+                }
+                break;
+            case 's':
+                stats = 1;
+                break;
+            case 'l':
+                G.latency_file = optarg;
+                break;
+            case 'u':
+                undo_limit = atoi(optarg);
+                if (undo_limit < 1) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'b':
+                script = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    // before any thread starts, so every thread blocks SIGWINCH. A batch
+    // run has no terminal to wait on.
+    struct EventLoop* events = script ? NULL : Event_new(STDIN_FILENO);
+    struct WorkPool* workers = Work_new(threads);
+    Gap_set_workers(workers);
+
+    struct BumpAlloc* bmp = Bump_new(KILOBYTES((size_t)64), MEM_OTHER);
     struct EditorContext* ctx = Bump_alloc(bmp, sizeof(*ctx));
-    enable_raw_mode();
-    atexit(disable_raw_mode);
+    if (stats) {
+        atexit(report_stats);
+    }
+    if (G.latency_file) {
+        atexit(dump_latency);
+    }
+    if (!script) {
+        enable_raw_mode();
+        atexit(disable_raw_mode);
+    }
     // argv is a NULL-terminated array, so this is fine
-    init_editor(ctx, argv[1], bmp);
-    if (argc > 1) {
-        file_open(ctx, argv[1]);
+    init_editor(ctx, argv[optind], bmp, script != NULL);
+    G.ctx = ctx;
+    ctx->workers = workers;
+    ctx->events = events;
+    ctx->autosave = autosave;
+    if (undo_limit) {
+        ctx->undo->limit = MEGABYTES((size_t)undo_limit);
+    }
+    if (optind < argc) {
+        file_open(ctx, argv[optind]);
     } else {
         ctx->gap = Gap_new("");
     }
-    set_status(ctx, "HELP: Ctrl-S to save | Ctrl-Q to quit");
+    if (script) {
+        FILE* in = strcmp(script, "-") ? fopen(script, "r") : stdin;
+        if (!in) {
+            perror(script);
+            quit(ctx, EXIT_FAILURE);
+        }
+        quit(ctx, Batch_run(ctx, in, script));
+    }
+    set_status(ctx,
+               "HELP: Ctrl-S save | Ctrl-Q quit | Ctrl-F/R find/regex | "
+               "Ctrl-Z/Y undo/redo");
 
     while (1) {
         refresh_ui(ctx);
-        char c = read_input();
-        handle_input(ctx, c);
+        // handle every key that has already arrived, then draw once
+        do {
+            char c = read_input(ctx);
+            handle_input(ctx, c);
+        } while (input_pending(ctx));
     }
     return EXIT_SUCCESS;
 }
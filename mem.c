@@ -1,44 +1,256 @@
 #include "mem.h"
 #include "util.h"
-#include <assert.h>
 #include <string.h>
 
+// live and peak bytes per tag. Updated from any thread.
+static size_t live[MEM_TAGS];
+static size_t peak[MEM_TAGS];
+// calls to Mem_alloc and friends per tag, for the benchmarks
+static size_t allocs[MEM_TAGS];
+
+static const char* names[MEM_TAGS] = {
+    [MEM_TEXT] = "text",       [MEM_MAPPED] = "mapped",
+    [MEM_LINES] = "lines",     [MEM_RENDER] = "render",
+    [MEM_UNDO] = "undo",       [MEM_SCRATCH] = "scratch",
+    [MEM_OTHER] = "other",
+};
+
+void
+Mem_count(enum MemTag tag, ssize_t delta)
+{
+    size_t now = __atomic_add_fetch(&live[tag], delta, __ATOMIC_RELAXED);
+    size_t high = __atomic_load_n(&peak[tag], __ATOMIC_RELAXED);
+    while (now > high && !__atomic_compare_exchange_n(&peak[tag],
+                                                      &high,
+                                                      now,
+                                                      1,
+                                                      __ATOMIC_RELAXED,
+                                                      __ATOMIC_RELAXED))
+        ;
+}
+
+size_t
+Mem_live(enum MemTag tag)
+{
+    return __atomic_load_n(&live[tag], __ATOMIC_RELAXED);
+}
+
+size_t
+Mem_peak(enum MemTag tag)
+{
+    return __atomic_load_n(&peak[tag], __ATOMIC_RELAXED);
+}
+
+size_t
+Mem_allocs(enum MemTag tag)
+{
+    return __atomic_load_n(&allocs[tag], __ATOMIC_RELAXED);
+}
+
+const char*
+Mem_name(enum MemTag tag)
+{
+    return names[tag];
+}
+
+// The allocators behind Mem_alloc and friends, which exit rather than
+// return NULL. They are kept here so every allocation is counted.
+static void*
+Malloc(size_t size)
+{
+    void* ptr = malloc(size);
+    if (!ptr) {
+        unix_error("malloc");
+    }
+    return ptr;
+}
+
+static void*
+Calloc(size_t count, size_t size)
+{
+    void* ptr = calloc(count, size);
+    if (!ptr) {
+        unix_error("calloc");
+    }
+    return ptr;
+}
+
+static void*
+Realloc(void* ptr, size_t size)
+{
+    void* new_ptr = realloc(ptr, size);
+    if (!new_ptr) {
+        unix_error("realloc");
+    }
+    return new_ptr;
+}
+
+// Malloc and friends, counted against `tag`. The caller passes the size
+// back when freeing, as it always knows it.
+void*
+Mem_alloc(enum MemTag tag, size_t size)
+{
+    Mem_count(tag, size);
+    __atomic_add_fetch(&allocs[tag], 1, __ATOMIC_RELAXED);
+    return Malloc(size);
+}
+
+void*
+Mem_calloc(enum MemTag tag, size_t count, size_t size)
+{
+    Mem_count(tag, count * size);
+    __atomic_add_fetch(&allocs[tag], 1, __ATOMIC_RELAXED);
+    return Calloc(count, size);
+}
+
+void*
+Mem_realloc(enum MemTag tag, void* ptr, size_t old_size, size_t size)
+{
+    Mem_count(tag, (ssize_t)size - (ssize_t)old_size);
+    __atomic_add_fetch(&allocs[tag], 1, __ATOMIC_RELAXED);
+    return Realloc(ptr, size);
+}
+
+void
+Mem_free(enum MemTag tag, void* ptr, size_t size)
+{
+    if (ptr) {
+        Mem_count(tag, -(ssize_t)size);
+        free(ptr);
+    }
+}
+
+static struct BumpBlock*
+Bump_block(enum MemTag tag, size_t size)
+{
+    struct BumpBlock* block = Mem_alloc(tag, sizeof(*block) + size);
+    block->prev = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+// `capacity` is the size of the first block, and of the blocks chained
+// after it unless a single allocation needs more
 struct BumpAlloc*
-Bump_new(size_t capacity)
+Bump_new(size_t capacity, enum MemTag tag)
 {
-    struct BumpAlloc* arena = Calloc(1, sizeof(struct BumpAlloc) + capacity);
-    arena->brk = (void*)(arena + 1);
-    arena->max = capacity;
+    struct BumpAlloc* arena = Mem_alloc(tag, sizeof(*arena));
+    arena->tag = tag;
+    arena->block = Bump_block(tag, capacity);
+    arena->spare = NULL;
+    arena->block_size = capacity;
     arena->allocated = 0;
     return arena;
 }
 
+void
+Bump_free(struct BumpAlloc* arena)
+{
+    struct BumpBlock* prev;
+    for (struct BumpBlock* block = arena->block; block; block = prev) {
+        prev = block->prev;
+        Mem_free(arena->tag, block, sizeof(*block) + block->size);
+    }
+    if (arena->spare) {
+        Mem_free(
+          arena->tag, arena->spare, sizeof(*arena->spare) + arena->spare->size);
+    }
+    Mem_free(arena->tag, arena, sizeof(*arena));
+}
+
+// memory that is not cleared, for callers that fill it anyway
 void*
-Bump_alloc(struct BumpAlloc* arena, size_t size)
+Bump_alloc_raw(struct BumpAlloc* arena, size_t size)
 {
     size = (size + 7) & ~7; // align to 8 bytes
-    assert(arena->allocated + size < arena->max);
-    void* ptr = arena->brk;
-    arena->brk += size;
+    struct BumpBlock* block = arena->block;
+    if (block->used + size > block->size) {
+        struct BumpBlock* spare = arena->spare;
+        if (spare && spare->size >= size) {
+            arena->spare = NULL;
+            spare->used = 0;
+            block = spare;
+        } else {
+            block = Bump_block(
+              arena->tag, size > arena->block_size ? size : arena->block_size);
+        }
+        block->prev = arena->block;
+        arena->block = block;
+    }
+    void* ptr = &block->data[block->used];
+    block->used += size;
     arena->allocated += size;
+    return ptr;
+}
+
+void*
+Bump_alloc(struct BumpAlloc* arena, size_t size)
+{
+    void* ptr = Bump_alloc_raw(arena, size);
     memset(ptr, 0, size);
     return ptr;
 }
 
-// fixed-size memory pool
+// a checkpoint to return to with Bump_reset
+struct BumpMark
+Bump_mark(struct BumpAlloc* arena)
+{
+    struct BumpMark mark = {
+        .block = arena->block,
+        .used = arena->block->used,
+        .allocated = arena->allocated,
+    };
+    return mark;
+}
+
+// release everything allocated since `mark`. One released block of the
+// usual size is kept, so scratch that is reset often does not go back to
+// malloc, while oversized blocks are returned right away.
+void
+Bump_reset(struct BumpAlloc* arena, struct BumpMark mark)
+{
+    while (arena->block != mark.block) {
+        struct BumpBlock* block = arena->block;
+        arena->block = block->prev;
+        if (!arena->spare && block->size == arena->block_size) {
+            arena->spare = block;
+        } else {
+            Mem_free(arena->tag, block, sizeof(*block) + block->size);
+        }
+    }
+    arena->block->used = mark.used;
+    arena->allocated = mark.allocated;
+}
+
+static void
+Pool_slab(struct MemoryPool* pool, size_t count)
+{
+    size_t bytes = sizeof(struct PoolSlab) + count * pool->block_size;
+    struct PoolSlab* slab = Mem_alloc(pool->tag, bytes);
+    pool->slab_bytes += bytes;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->brk = (void*)(slab + 1);
+    pool->max_count = count;
+    pool->allocated = 0;
+}
+
+// fixed-size memory pool, starting with a slab of `capacity` blocks
 struct MemoryPool*
-Pool_new(size_t capacity, size_t block_size)
+Pool_new(size_t capacity, size_t block_size, enum MemTag tag)
 {
     // make it a multiple of 8 for alignment
     // this also guarantees that the block will be a least 8 bytes
     // which is enough to hold a pointer to the next node in the freelist
     block_size = (block_size + 7) & ~7;
-    struct MemoryPool* pool = Malloc(sizeof(*pool) + capacity * block_size);
-    pool->max_count = capacity;
+    struct MemoryPool* pool = Mem_alloc(tag, sizeof(*pool));
     pool->block_size = block_size;
-    pool->allocated = 0;
-    pool->brk = (void*)(pool + 1);
     pool->freelist = NULL;
+    pool->slabs = NULL;
+    pool->slab_bytes = 0;
+    pool->tag = tag;
+    Pool_slab(pool, capacity ? capacity : 1);
     return pool;
 }
 
@@ -50,14 +262,15 @@ Pool_alloc(struct MemoryPool* pool)
         pool->freelist = free->next;
         memset(free, 0, sizeof(*free));
         return free;
-    } else if (pool->allocated < pool->max_count) {
-        void* ptr = pool->brk;
-        pool->brk += pool->block_size;
-        pool->allocated++;
-        return ptr;
-    } else {
-        return NULL;
     }
+    if (pool->allocated == pool->max_count) {
+        size_t count = pool->max_count * 2;
+        Pool_slab(pool, count < POOL_MAX_SLAB ? count : POOL_MAX_SLAB);
+    }
+    void* ptr = pool->brk;
+    pool->brk += pool->block_size;
+    pool->allocated++;
+    return ptr;
 }
 
 void
@@ -65,4 +278,43 @@ Pool_free(struct MemoryPool* pool, void* ptr)
 {
     struct PoolFreeList* free = ptr;
     free->next = pool->freelist;
+    pool->freelist = free;
+}
+
+// take over the slabs and free blocks of `other`, which must have the same
+// block size, so blocks from both can be freed to `pool`. `other` is
+// consumed.
+void
+Pool_merge(struct MemoryPool* pool, struct MemoryPool* other)
+{
+    struct PoolSlab* last = other->slabs;
+    while (last->next) {
+        last = last->next;
+    }
+    // the current slab stays first so allocation continues from it
+    last->next = pool->slabs->next;
+    pool->slabs->next = other->slabs;
+    if (other->freelist) {
+        struct PoolFreeList* tail = other->freelist;
+        while (tail->next) {
+            tail = tail->next;
+        }
+        tail->next = pool->freelist;
+        pool->freelist = other->freelist;
+    }
+    pool->slab_bytes += other->slab_bytes;
+    Mem_free(other->tag, other, sizeof(*other));
+}
+
+// release the pool and every block in it
+void
+Pool_delete(struct MemoryPool* pool)
+{
+    struct PoolSlab* next;
+    for (struct PoolSlab* slab = pool->slabs; slab; slab = next) {
+        next = slab->next;
+        free(slab);
+    }
+    Mem_count(pool->tag, -(ssize_t)pool->slab_bytes);
+    Mem_free(pool->tag, pool, sizeof(*pool));
 }
@@ -2,38 +2,116 @@
 #define MEM_MODULE
 
 #include <stdlib.h>
+#include <sys/types.h>
 #define KILOBYTES(i) ((i) * 1024)
 #define MEGABYTES(i) (KILOBYTES((i)) * 1024)
 
+// what memory is used for, for accounting
+enum MemTag
+{
+    MEM_TEXT,    // gap buffers on the heap
+    MEM_MAPPED,  // gap buffers mapped from files
+    MEM_LINES,   // line indexes
+    MEM_RENDER,  // render cache, frames and output buffers
+    MEM_UNDO,    // undo history
+    MEM_SCRATCH, // arenas and short-lived buffers
+    MEM_OTHER,
+    MEM_TAGS
+};
+
+void
+Mem_count(enum MemTag tag, ssize_t delta);
+size_t
+Mem_live(enum MemTag tag);
+size_t
+Mem_peak(enum MemTag tag);
+size_t
+Mem_allocs(enum MemTag tag);
+const char*
+Mem_name(enum MemTag tag);
+void*
+Mem_alloc(enum MemTag tag, size_t size);
+void*
+Mem_calloc(enum MemTag tag, size_t count, size_t size);
+void*
+Mem_realloc(enum MemTag tag, void* ptr, size_t old_size, size_t size);
+void
+Mem_free(enum MemTag tag, void* ptr, size_t size);
+
+struct BumpBlock
+{
+    struct BumpBlock* prev;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+// A bump allocator that chains a new block when the current one is full,
+// so it never runs out. Everything allocated after a Bump_mark is released
+// at once by Bump_reset.
 struct BumpAlloc
 {
-    size_t max;
+    struct BumpBlock* block; // the block allocations come from
+    struct BumpBlock* spare; // a released block kept for reuse
+    size_t block_size;       // size of new blocks, unless asked for more
+    size_t allocated;        // bytes handed out and not released
+    enum MemTag tag;
+};
+
+struct BumpMark
+{
+    struct BumpBlock* block;
+    size_t used;
     size_t allocated;
-    char* brk;
 };
 
 struct BumpAlloc*
-Bump_new(size_t capacity);
+Bump_new(size_t capacity, enum MemTag tag);
+void
+Bump_free(struct BumpAlloc* bump);
 void*
 Bump_alloc(struct BumpAlloc* bump, size_t size);
+void*
+Bump_alloc_raw(struct BumpAlloc* bump, size_t size);
+struct BumpMark
+Bump_mark(struct BumpAlloc* bump);
+void
+Bump_reset(struct BumpAlloc* bump, struct BumpMark mark);
 
 struct PoolFreeList
 {
     struct PoolFreeList* next;
 };
+struct PoolSlab
+{
+    struct PoolSlab* next;
+};
+// Fixed-size blocks carved out of slabs. Freed blocks go on a freelist and
+// are handed out again first. A full pool chains a new slab, twice the
+// size of the last one up to POOL_MAX_SLAB blocks.
 struct MemoryPool
 {
-    size_t max_count;
-    size_t allocated;
+    size_t max_count; // blocks in the current slab
+    size_t allocated; // blocks taken from the current slab
     size_t block_size;
     char* brk;
     struct PoolFreeList* freelist;
+    struct PoolSlab* slabs;
+    size_t slab_bytes; // total size of the slabs
+    enum MemTag tag;
 };
+
+#define POOL_MAX_SLAB (1024)
+
 struct MemoryPool*
-Pool_new(size_t capacity, size_t block_size);
+Pool_new(size_t capacity, size_t block_size, enum MemTag tag);
 void*
 Pool_alloc(struct MemoryPool* pool);
 void
 Pool_free(struct MemoryPool* pool, void* ptr);
+void
+Pool_merge(struct MemoryPool* pool, struct MemoryPool* other);
+void
+Pool_delete(struct MemoryPool* pool);
 
 #endif // !MEM_MODULE
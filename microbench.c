@@ -0,0 +1,745 @@
+#include "gap.h"
+#include "mem.h"
+#include "re.h"
+#include "replace.h"
+#include "search.h"
+#include "util.h"
+#include "work.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LINE_WIDTH (80)
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// parse sizes like 4096, 1K, 1M, 100M, 1G
+static size_t
+parse_size(const char* s)
+{
+    char* end;
+    size_t n = strtoull(s, &end, 10);
+    switch (*end) {
+        case 'k':
+        case 'K':
+            return KILOBYTES(n);
+        case 'm':
+        case 'M':
+            return MEGABYTES(n);
+        case 'g':
+        case 'G':
+            return MEGABYTES(n) * 1024;
+        default:
+            return n;
+    }
+}
+
+// text of `size` bytes made of LINE_WIDTH-wide lines
+static char*
+make_text(size_t size)
+{
+    char* text = Mem_alloc(MEM_SCRATCH, size + 1);
+    for (size_t i = 0; i < size; i++) {
+        text[i] = (i % LINE_WIDTH == LINE_WIDTH - 1) ? '\n' : 'a' + i % 26;
+    }
+    text[size] = '\0';
+    return text;
+}
+
+// free text of `size` bytes from make_text or make_long_lines
+static void
+free_text(char* text, size_t size)
+{
+    Mem_free(MEM_SCRATCH, text, size + 1);
+}
+
+static void
+report(const char* name, size_t size, size_t ops, size_t bytes, double secs)
+{
+    printf("%-12s %10zu bytes %10zu ops %10.1f ns/op %10.2f MB/s\n",
+           name,
+           size,
+           ops,
+           secs * 1e9 / ops,
+           bytes / secs / MEGABYTES(1.0));
+}
+
+// typing: single characters inserted at one spot in the middle of the buffer
+static void
+bench_insert_chr(size_t size, size_t ops)
+{
+    char* text = make_text(size);
+    struct GapBuffer* gap = Gap_new(text);
+    Gap_mov(gap, size / 2);
+    double start = now();
+    for (size_t i = 0; i < ops; i++) {
+        Gap_insert_chr(gap, 'x');
+    }
+    report("insert_chr", size, ops, ops, now() - start);
+    Gap_free(gap);
+    free_text(text, size);
+}
+
+// pasting: 4K blocks inserted at one spot in the middle of the buffer
+static void
+bench_insert_str(size_t size, size_t ops)
+{
+    char* text = make_text(size);
+    char* block = make_text(KILOBYTES(4));
+    struct GapBuffer* gap = Gap_new(text);
+    Gap_mov(gap, size / 2);
+    double start = now();
+    for (size_t i = 0; i < ops; i++) {
+        Gap_insert_str(gap, block);
+    }
+    report("insert_str", size, ops, ops * KILOBYTES(4), now() - start);
+    Gap_free(gap);
+    free_text(block, KILOBYTES(4));
+    free_text(text, size);
+}
+
+// write a file of `size` bytes of text in LINE_WIDTH-wide lines
+static int
+make_file(size_t size)
+{
+    char path[] = "/tmp/microbench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        unix_error("mkstemp");
+    }
+    unlink(path);
+    size_t block_size = LINE_WIDTH * KILOBYTES(16);
+    char* block = make_text(block_size);
+    for (size_t written = 0; written < size;) {
+        size_t len = size - written;
+        ssize_t n = write(fd, block, len < block_size ? len : block_size);
+        if (n <= 0) {
+            unix_error("write");
+        }
+        written += n;
+    }
+    free_text(block, block_size);
+    return fd;
+}
+
+// newline indexing of a mapped file with 1, 2, 4 ... max_threads threads
+static void
+bench_index(size_t size, int max_threads)
+{
+    int fd = make_file(size);
+    struct WorkPool* pool = Work_new(max_threads);
+    for (int threads = 1;; threads *= 2) {
+        if (threads > max_threads) {
+            threads = max_threads;
+        }
+        Work_set_threads(pool, threads);
+        Gap_set_workers(threads > 1 ? pool : NULL);
+        struct GapBuffer* gap = Gap_map(fd, size);
+        if (!gap) {
+            unix_error("mmap");
+        }
+        double start = now();
+        ssize_t lines = Gap_lines(gap);
+        double secs = now() - start;
+        printf("index        %10zu bytes %10zd lines %3d threads %8.1f ms "
+               "%10.2f MB/s\n",
+               size,
+               lines,
+               threads,
+               secs * 1e3,
+               size / secs / MEGABYTES(1.0));
+        Gap_free(gap);
+        if (threads == max_threads) {
+            break;
+        }
+    }
+    Gap_set_workers(NULL);
+    Work_free(pool);
+    close(fd);
+}
+
+// a search for a pattern that only occurs at the very end of the text,
+// with the gap in the middle
+static void
+bench_search(size_t size)
+{
+    const char pat[] = "needle in a haystack";
+    char* text = make_text(size);
+    memcpy(&text[size - sizeof(pat)], pat, sizeof(pat) - 1);
+    struct GapBuffer* gap = Gap_new(text);
+    Gap_mov(gap, size / 2 - gap->cur_beg);
+    struct Search search;
+    Search_init(&search, pat, sizeof(pat) - 1);
+    double start = now();
+    ssize_t found = Search_first(&search, gap, 0, gap->size);
+    double secs = now() - start;
+    printf("search       %10zu bytes %10zd found  %8.1f ms %10.2f MB/s\n",
+           size,
+           found,
+           secs * 1e3,
+           size / secs / MEGABYTES(1.0));
+    start = now();
+    found = Search_last(&search, gap, 0, size - sizeof(pat));
+    secs = now() - start;
+    printf("search back  %10zu bytes %10zd found  %8.1f ms %10.2f MB/s\n",
+           size,
+           found,
+           secs * 1e3,
+           size / secs / MEGABYTES(1.0));
+    Gap_free(gap);
+    free_text(text, size);
+}
+
+// write a file of `size` bytes of web server style log lines
+static int
+make_log(size_t size)
+{
+    static const char* paths[] = { "users", "orders", "items", "search" };
+    static const char* levels[] = { "INFO ", "INFO ", "DEBUG", "WARN " };
+    char path[] = "/tmp/microbench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        unix_error("mkstemp");
+    }
+    unlink(path);
+    FILE* out = fdopen(dup(fd), "w");
+    unsigned seed = 1;
+    for (size_t written = 0; written < size;) {
+        seed = seed * 1103515245 + 12345;
+        unsigned r = seed >> 8;
+        int n = fprintf(out,
+                        "2024-05-%02u %02u:%02u:%02u %s "
+                        "GET /api/%s/%u %u %ums\n",
+                        1 + r % 28,
+                        r % 24,
+                        r % 60,
+                        (r >> 6) % 60,
+                        levels[r % 4],
+                        paths[(r >> 3) % 4],
+                        r % 100000,
+                        r % 7 ? 200 : 404,
+                        r % 250);
+        written += n;
+    }
+    fclose(out);
+    if (ftruncate(fd, size) == -1) {
+        unix_error("ftruncate");
+    }
+    return fd;
+}
+
+// walk every match of `pat` in `gap` as replace-all does, timing the walk
+static void
+time_regex(const char* name, const char* pat, struct GapBuffer* gap)
+{
+    const char* err;
+    struct Regex* re = Re_compile(pat, strlen(pat), &err);
+    if (!re) {
+        fprintf(stderr, "%s: %s\n", pat, err);
+        return;
+    }
+    ssize_t found = 0;
+    ssize_t end;
+    double start = now();
+    for (ssize_t m = 0; (m = Re_first(re, gap, m, gap->size, &end)) != -1;
+         found++) {
+        // step past empty matches
+        m = end > m ? end : m + 1;
+    }
+    double secs = now() - start;
+    printf("%-12s %10zd bytes %10zd found  %8.1f ms %10.2f MB/s %s\n",
+           name,
+           gap->size,
+           found,
+           secs * 1e3,
+           gap->size / secs / MEGABYTES(1.0),
+           pat);
+    Re_free(re);
+}
+
+// regular expressions over the log: ones that never match, so the whole log
+// is read, and ones matching many times a line. Then the many matches again
+// on one long line, where each match must not reread the line.
+static void
+bench_regex(int fd, size_t size)
+{
+    const char* patterns[] = {
+        "ERROR",
+        "GET /api/[a-z]+/[0-9]+ 5[0-9][0-9]",
+        "^2024-05-[0-9]+ [0-9:]+ (INFO|WARN) .* 200 [0-9][0-9][0-9][0-9]ms$",
+        "(.*)*(.*)*x$",
+        "[0-9]+",
+        "[a-z]+/[0-9]+|[0-9]+ms$",
+    };
+    struct GapBuffer* gap = Gap_map(fd, size);
+    if (!gap) {
+        unix_error("mmap");
+    }
+    // fault the mapping in, so the first pattern is not charged for it
+    Gap_lines(gap);
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(*patterns); i++) {
+        time_regex("regex", patterns[i], gap);
+    }
+    Gap_free(gap);
+    size_t line = size < MEGABYTES(64) ? size : MEGABYTES(64);
+    char* text = Mem_alloc(MEM_SCRATCH, line + 1);
+    static const char words[] = "GET /api/items/4711 200 35ms ";
+    for (size_t i = 0; i < line; i++) {
+        text[i] = words[i % (sizeof(words) - 1)];
+    }
+    text[line] = '\0';
+    gap = Gap_new(text);
+    free_text(text, line);
+    time_regex("regex line", "[0-9]+", gap);
+    time_regex("regex line", "[a-z]+/[0-9]+|[0-9]+ms", gap);
+    Gap_free(gap);
+}
+
+// replace-all over a mapped log with 1, 2, 4 ... max_threads threads: the
+// parallel search for matches, then the one pass that splices them in. A
+// literal, and a regular expression matching once on every line
+static void
+bench_replace(size_t size, int max_threads)
+{
+    static const struct Replace workloads[] = {
+        { .pat = "GET", .len = 3, .with = "POST", .with_len = 4 },
+        { .pat = "[0-9]+ms$",
+          .len = 9,
+          .regex = 1,
+          .with = "0ms",
+          .with_len = 3 },
+    };
+    int fd = make_log(size);
+    struct WorkPool* pool = Work_new(max_threads);
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(*workloads); w++) {
+        for (int threads = 1;; threads *= 2) {
+            if (threads > max_threads) {
+                threads = max_threads;
+            }
+            Work_set_threads(pool, threads);
+            struct WorkPool* workers = threads > 1 ? pool : NULL;
+            Gap_set_workers(workers);
+            struct GapBuffer* gap = Gap_map(fd, size);
+            if (!gap) {
+                unix_error("mmap");
+            }
+            Gap_lines(gap);
+            struct Replace rep = workloads[w];
+            double start = now();
+            ssize_t count = Replace_find(&rep, gap, workers);
+            double found = now();
+            Gap_splice(gap, rep.edits, rep.count);
+            double secs = now() - start;
+            printf("replace      %10zu bytes %10zd found  %3d threads "
+                   "%8.1f ms (find %.1f ms) %10.2f MB/s %s\n",
+                   size,
+                   count,
+                   threads,
+                   secs * 1e3,
+                   (found - start) * 1e3,
+                   size / secs / MEGABYTES(1.0),
+                   rep.pat);
+            Replace_free(&rep);
+            Gap_free(gap);
+            if (threads == max_threads) {
+                break;
+            }
+        }
+    }
+    Gap_set_workers(NULL);
+    Work_free(pool);
+    close(fd);
+}
+
+// where each op of the gap benchmark happens
+enum Pattern
+{
+    PATTERN_SEQUENTIAL, // where the last op left the cursor, as when typing
+    PATTERN_RANDOM,     // at a random offset, jumped to as part of the op
+    PATTERN_LONG_LINE,  // sequentially, in text of a few very long lines
+    PATTERNS
+};
+
+static const char* pattern_names[PATTERNS] = {
+    [PATTERN_SEQUENTIAL] = "seq",
+    [PATTERN_RANDOM] = "random",
+    [PATTERN_LONG_LINE] = "longline",
+};
+
+// how long each primitive is timed for, per size and pattern
+#define GAP_BENCH_SECS (0.1)
+#define GAP_BENCH_BLOCK (KILOBYTES(1))
+
+struct GapBench
+{
+    struct GapBuffer* gap;
+    enum Pattern pattern;
+    uint64_t seed;
+    ssize_t read_at; // where Gap_substr reads next, in sequence
+    char block[GAP_BENCH_BLOCK + 1];
+    char out[LINE_WIDTH + 1];
+};
+
+static ssize_t
+random_offset(struct GapBench* b)
+{
+    b->seed ^= b->seed << 13;
+    b->seed ^= b->seed >> 7;
+    b->seed ^= b->seed << 17;
+    return b->gap->size ? b->seed % b->gap->size : 0;
+}
+
+// move the cursor to a random offset when jumping around, returning the
+// bytes moved
+static ssize_t
+jump(struct GapBench* b)
+{
+    if (b->pattern != PATTERN_RANDOM) {
+        return 0;
+    }
+    ssize_t steps = random_offset(b) - b->gap->cur_beg;
+    Gap_mov(b->gap, steps);
+    return steps < 0 ? -steps : steps;
+}
+
+// each op returns the bytes it inserted, moved past, deleted or copied
+static ssize_t
+op_insert_chr(struct GapBench* b)
+{
+    ssize_t moved = jump(b);
+    Gap_insert_chr(b->gap, 'x');
+    return moved + 1;
+}
+
+static ssize_t
+op_insert_str(struct GapBench* b)
+{
+    ssize_t moved = jump(b);
+    Gap_insert_str(b->gap, b->block);
+    return moved + GAP_BENCH_BLOCK;
+}
+
+static ssize_t
+op_mov(struct GapBench* b)
+{
+    if (b->pattern == PATTERN_RANDOM) {
+        return jump(b);
+    }
+    if (b->gap->cur_beg == b->gap->size) {
+        Gap_mov(b->gap, -b->gap->size);
+    }
+    Gap_mov(b->gap, 1);
+    return 1;
+}
+
+static ssize_t
+op_del(struct GapBench* b)
+{
+    ssize_t moved = jump(b);
+    Gap_del(b->gap, 1);
+    return moved + 1;
+}
+
+static ssize_t
+op_substr(struct GapBench* b)
+{
+    ssize_t at = b->pattern == PATTERN_RANDOM ? random_offset(b) : b->read_at;
+    ssize_t to = at + LINE_WIDTH;
+    if (to > b->gap->size) {
+        at = 0;
+        to = b->gap->size < LINE_WIDTH ? b->gap->size : LINE_WIDTH;
+    }
+    Gap_substr(b->gap, at, to, b->out);
+    b->read_at = to;
+    return to - at;
+}
+
+// line navigation wraps around at either end of the text
+static ssize_t
+op_nextline(struct GapBench* b)
+{
+    ssize_t moved = jump(b);
+    ssize_t from = b->gap->cur_beg;
+    Gap_nextline(b->gap);
+    if (b->gap->cur_beg == from) {
+        Gap_mov(b->gap, -from);
+    }
+    ssize_t steps = b->gap->cur_beg - from;
+    return moved + (steps < 0 ? -steps : steps);
+}
+
+static ssize_t
+op_prevline(struct GapBench* b)
+{
+    ssize_t moved = jump(b);
+    ssize_t from = b->gap->cur_beg;
+    Gap_prevline(b->gap);
+    if (b->gap->cur_beg == from) {
+        Gap_mov(b->gap, b->gap->size - from);
+    }
+    ssize_t steps = b->gap->cur_beg - from;
+    return moved + (steps < 0 ? -steps : steps);
+}
+
+// Ops that change the size of the text by `grows` bytes run on a fresh
+// copy once they have changed it by half, so the size stays about right
+static const struct GapOp
+{
+    const char* name;
+    ssize_t (*run)(struct GapBench* b);
+    size_t grows;
+} gap_ops[] = {
+    { "insert_chr", op_insert_chr, 1 },
+    { "insert_str", op_insert_str, GAP_BENCH_BLOCK },
+    { "mov", op_mov, 0 },
+    { "del", op_del, 1 },
+    { "substr", op_substr, 0 },
+    { "nextline", op_nextline, 0 },
+    { "prevline", op_prevline, 0 },
+};
+
+static size_t
+count_allocs(void)
+{
+    size_t n = 0;
+    for (int tag = 0; tag < MEM_TAGS; tag++) {
+        n += Mem_allocs(tag);
+    }
+    return n;
+}
+
+// text of `size` bytes made of eight lines, or LINE_WIDTH-wide ones if
+// the text is too small for that
+static char*
+make_long_lines(size_t size)
+{
+    size_t width = size / 8 > LINE_WIDTH ? size / 8 : LINE_WIDTH;
+    char* text = Mem_alloc(MEM_SCRATCH, size + 1);
+    for (size_t i = 0; i < size; i++) {
+        text[i] = (i % width == width - 1) ? '\n' : 'a' + i % 26;
+    }
+    text[size] = '\0';
+    return text;
+}
+
+// Time one primitive for GAP_BENCH_SECS, in batches that double in size
+// so the clock is read rarely. The buffer is indexed first, as it is in
+// the editor, and its gap opened to what the policy wants, as a buffer
+// fresh from Gap_new has almost none. Only the ops themselves are timed.
+static void
+bench_gap_op(const struct GapOp* op,
+             enum Pattern pattern,
+             char* text,
+             size_t size)
+{
+    struct GapBench b = { .pattern = pattern, .seed = 0x9e3779b97f4a7c15 };
+    memset(b.block, 'x', GAP_BENCH_BLOCK);
+    b.block[GAP_BENCH_BLOCK] = '\0';
+    size_t limit = op->grows ? size / 2 / op->grows + 1 : SIZE_MAX;
+    size_t ops = 0, bytes = 0, allocs = 0;
+    double secs = 0;
+    while (secs < GAP_BENCH_SECS) {
+        b.gap = Gap_new(text);
+        Gap_lines(b.gap);
+        Gap_mov(b.gap, size / 4);
+        b.read_at = size / 4;
+        Gap_insert(b.gap, b.block, GAP_BENCH_BLOCK);
+        Gap_mov(b.gap, -GAP_BENCH_BLOCK);
+        Gap_del(b.gap, GAP_BENCH_BLOCK);
+        size_t done = 0;
+        size_t batch = 1;
+        while (done < limit && secs < GAP_BENCH_SECS) {
+            batch = batch < limit - done ? batch : limit - done;
+            size_t before = count_allocs();
+            double start = now();
+            for (size_t i = 0; i < batch; i++) {
+                bytes += op->run(&b);
+            }
+            secs += now() - start;
+            allocs += count_allocs() - before;
+            done += batch;
+            batch *= 2;
+        }
+        ops += done;
+        Gap_free(b.gap);
+    }
+    printf("%-10s %-8s %10zu bytes %10zu ops %12.1f ns/op %10.2f MB/s "
+           "%8zu allocs\n",
+           op->name,
+           pattern_names[pattern],
+           size,
+           ops,
+           secs * 1e9 / ops,
+           bytes / secs / MEGABYTES(1.0),
+           allocs);
+}
+
+static void
+bench_gap(size_t size)
+{
+    for (int pattern = 0; pattern < PATTERNS; pattern++) {
+        char* text = pattern == PATTERN_LONG_LINE ? make_long_lines(size)
+                                                  : make_text(size);
+        for (size_t i = 0; i < sizeof(gap_ops) / sizeof(*gap_ops); i++) {
+            bench_gap_op(&gap_ops[i], pattern, text, size);
+        }
+        free_text(text, size);
+    }
+}
+
+static void
+usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s insert [-f] [size...]\n", prog);
+    fprintf(stderr, "       %s index [-t threads] [size]\n", prog);
+    fprintf(stderr, "       %s search [size...]\n", prog);
+    fprintf(stderr, "       %s regex [-f file] [size]\n", prog);
+    fprintf(stderr, "       %s replace [-t threads] [size]\n", prog);
+    fprintf(stderr, "       %s gap [size...]\n", prog);
+    fprintf(stderr, "  -f  use the old fixed 16 byte gap growth\n");
+    fprintf(stderr, "  insert sizes default to 1K 1M 100M\n");
+    fprintf(stderr, "  index defaults to a 2G file and one thread per core\n");
+    fprintf(stderr, "  search sizes default to 1M 100M 1G\n");
+    fprintf(stderr, "  regex reads a 500M generated log, or the given file\n");
+    fprintf(stderr, "  replace uses a 500M log and one thread per core\n");
+    fprintf(stderr, "  gap sizes default to 1K 64K 1M 16M 256M 1G\n");
+    exit(EXIT_FAILURE);
+}
+
+static void
+run_insert(int argc, char* argv[])
+{
+    const char* defaults[] = { "1K", "1M", "100M" };
+    const char** sizes = defaults;
+    int n_sizes = sizeof(defaults) / sizeof(*defaults);
+    int arg = 0;
+    if (arg < argc && !strcmp(argv[arg], "-f")) {
+        struct GapPolicy fixed = {
+            .min_gap = 16, .max_gap = 16, .grow_pct = 0, .shrink_mul = 1
+        };
+        Gap_set_policy(&fixed);
+        arg++;
+    }
+    if (arg < argc) {
+        sizes = (const char**)&argv[arg];
+        n_sizes = argc - arg;
+    }
+    for (int i = 0; i < n_sizes; i++) {
+        size_t size = parse_size(sizes[i]);
+        bench_insert_chr(size, MEGABYTES(1));
+        bench_insert_str(size, KILOBYTES(1));
+    }
+}
+
+static void
+run_index(int argc, char* argv[])
+{
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t size = parse_size("2G");
+    for (int arg = 0; arg < argc; arg++) {
+        if (!strcmp(argv[arg], "-t") && arg + 1 < argc) {
+            threads = atoi(argv[++arg]);
+        } else {
+            size = parse_size(argv[arg]);
+        }
+    }
+    bench_index(size, threads < 1 ? 1 : threads);
+}
+
+static void
+run_search(int argc, char* argv[])
+{
+    const char* defaults[] = { "1M", "100M", "1G" };
+    const char** sizes = argc ? (const char**)argv : defaults;
+    int n_sizes = argc ? argc : (int)(sizeof(defaults) / sizeof(*defaults));
+    for (int i = 0; i < n_sizes; i++) {
+        bench_search(parse_size(sizes[i]));
+    }
+}
+
+static void
+run_regex(int argc, char* argv[])
+{
+    size_t size = parse_size("500M");
+    const char* file = NULL;
+    for (int arg = 0; arg < argc; arg++) {
+        if (!strcmp(argv[arg], "-f") && arg + 1 < argc) {
+            file = argv[++arg];
+        } else {
+            size = parse_size(argv[arg]);
+        }
+    }
+    int fd;
+    if (file) {
+        struct stat st;
+        fd = open(file, O_RDONLY);
+        if (fd == -1 || fstat(fd, &st) == -1) {
+            unix_error(file);
+        }
+        size = st.st_size;
+    } else {
+        fd = make_log(size);
+    }
+    bench_regex(fd, size);
+    close(fd);
+}
+
+static void
+run_replace(int argc, char* argv[])
+{
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t size = parse_size("500M");
+    for (int arg = 0; arg < argc; arg++) {
+        if (!strcmp(argv[arg], "-t") && arg + 1 < argc) {
+            threads = atoi(argv[++arg]);
+        } else {
+            size = parse_size(argv[arg]);
+        }
+    }
+    bench_replace(size, threads < 1 ? 1 : threads);
+}
+
+static void
+run_gap(int argc, char* argv[])
+{
+    const char* defaults[] = { "1K", "64K", "1M", "16M", "256M", "1G" };
+    const char** sizes = argc ? (const char**)argv : defaults;
+    int n_sizes = argc ? argc : (int)(sizeof(defaults) / sizeof(*defaults));
+    for (int i = 0; i < n_sizes; i++) {
+        bench_gap(parse_size(sizes[i]));
+    }
+}
+
+int
+main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        usage(argv[0]);
+    } else if (!strcmp(argv[1], "insert")) {
+        run_insert(argc - 2, argv + 2);
+    } else if (!strcmp(argv[1], "index")) {
+        run_index(argc - 2, argv + 2);
+    } else if (!strcmp(argv[1], "search")) {
+        run_search(argc - 2, argv + 2);
+    } else if (!strcmp(argv[1], "regex")) {
+        run_regex(argc - 2, argv + 2);
+    } else if (!strcmp(argv[1], "replace")) {
+        run_replace(argc - 2, argv + 2);
+    } else if (!strcmp(argv[1], "gap")) {
+        run_gap(argc - 2, argv + 2);
+    } else {
+        usage(argv[0]);
+    }
+    return EXIT_SUCCESS;
+}
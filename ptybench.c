@@ -0,0 +1,495 @@
+// for memmem
+#define _GNU_SOURCE
+#include "mem.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ROWS (24)
+#define COLS (80)
+#define LINE_WIDTH (80)
+// how long the editor may go without reading or writing anything, in ms
+#define STALL_MS (60000)
+// output kept to find the first frame and the stats the editor prints
+#define TAIL (KILOBYTES(4))
+
+#define PG_DWN ("\x1b[6~")
+#define HOME ("\x1b[H")
+#define PASTE_BEGIN ("\x1b[200~")
+#define PASTE_END ("\x1b[201~")
+#define CTRL_KEY(k) ((k) & 0x1f)
+// the editor ends every frame with this
+#define SHOW_CURSOR ("\x1b[?25h")
+
+// keystrokes replayed against `file`. Key i is keys[ends[i - 1], ends[i]).
+struct Trace
+{
+    const char* name;
+    const char* file;
+    char* keys;
+    size_t len, cap;
+    size_t* ends;
+    size_t count, ends_cap;
+};
+
+struct Result
+{
+    double secs;   // from the first key to the editor exiting
+    size_t frames; // as counted by the editor, the first one included
+    size_t bytes;  // written by the editor to the terminal
+};
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// parse sizes like 4096, 1K, 1M, 100M, 1G
+static size_t
+parse_size(const char* s)
+{
+    char* end;
+    size_t n = strtoull(s, &end, 10);
+    switch (*end) {
+        case 'k':
+        case 'K':
+            return KILOBYTES(n);
+        case 'm':
+        case 'M':
+            return MEGABYTES(n);
+        case 'g':
+        case 'G':
+            return MEGABYTES(n) * 1024;
+        default:
+            return n;
+    }
+}
+
+// more bytes of the key being added
+static void
+append(struct Trace* trace, const char* bytes, size_t len)
+{
+    if (trace->len + len > trace->cap) {
+        size_t cap = 2 * (trace->len + len);
+        trace->keys = Mem_realloc(MEM_OTHER, trace->keys, trace->cap, cap);
+        trace->cap = cap;
+    }
+    memcpy(&trace->keys[trace->len], bytes, len);
+    trace->len += len;
+}
+
+static void
+end_key(struct Trace* trace)
+{
+    if (trace->count == trace->ends_cap) {
+        size_t cap = trace->ends_cap ? 2 * trace->ends_cap : 1024;
+        trace->ends = Mem_realloc(MEM_OTHER,
+                                  trace->ends,
+                                  trace->ends_cap * sizeof(*trace->ends),
+                                  cap * sizeof(*trace->ends));
+        trace->ends_cap = cap;
+    }
+    trace->ends[trace->count++] = trace->len;
+}
+
+static void
+add_key(struct Trace* trace, const char* key, size_t len)
+{
+    append(trace, key, len);
+    end_key(trace);
+}
+
+#define PATH_LEN (32)
+
+// a name for a file that does not exist yet, PATH_LEN bytes long
+static char*
+new_path(void)
+{
+    char* path = Mem_alloc(MEM_OTHER, PATH_LEN);
+    strcpy(path, "/tmp/ptybench-XXXXXX");
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        unix_error("mkstemp");
+    }
+    close(fd);
+    unlink(path);
+    return path;
+}
+
+// a file of `size` bytes in numbered LINE_WIDTH-wide lines, so every page
+// differs, with "needle" only on the last line
+static char*
+make_file(size_t size)
+{
+    char* path = new_path();
+    FILE* out = Fopen(path, "w");
+    char line[LINE_WIDTH];
+    for (size_t i = 0; i < LINE_WIDTH - 1; i++) {
+        line[i] = 'a' + i % 26;
+    }
+    line[LINE_WIDTH - 1] = '\n';
+    for (size_t written = 0; written + 2 * LINE_WIDTH <= size;) {
+        char number[16];
+        int n = snprintf(number, sizeof(number), "%zu ", written / LINE_WIDTH);
+        memcpy(line, number, n);
+        fwrite(line, 1, LINE_WIDTH, out);
+        written += LINE_WIDTH;
+    }
+    fputs("a needle at the end\n", out);
+    fclose(out);
+    return path;
+}
+
+// typing prose into a new file, a line at a time
+static void
+trace_typing(struct Trace* trace, size_t keys)
+{
+    const char line[] = "the quick brown fox jumps over the lazy dog\r";
+    for (size_t i = 0; i < keys; i++) {
+        add_key(trace, &line[i % (sizeof(line) - 1)], 1);
+    }
+}
+
+// 16K bracketed pastes into a new file, each one a key
+static void
+trace_paste(struct Trace* trace, size_t pastes)
+{
+    char block[KILOBYTES(16)];
+    for (size_t i = 0; i < sizeof(block); i++) {
+        block[i] = (i % LINE_WIDTH == LINE_WIDTH - 1) ? '\r' : 'a' + i % 26;
+    }
+    for (size_t i = 0; i < pastes; i++) {
+        append(trace, PASTE_BEGIN, strlen(PASTE_BEGIN));
+        append(trace, block, sizeof(block));
+        add_key(trace, PASTE_END, strlen(PASTE_END));
+    }
+}
+
+// paging down from the top of a file of `size` bytes to its end
+static void
+trace_pgdown(struct Trace* trace, size_t size)
+{
+    size_t pages = size / LINE_WIDTH / (ROWS - 2) + 1;
+    for (size_t i = 0; i < pages; i++) {
+        add_key(trace, PG_DWN, strlen(PG_DWN));
+    }
+}
+
+// incremental searches from the top for a word only found at the end
+static void
+trace_search(struct Trace* trace, size_t searches)
+{
+    const char keys[] = { CTRL_KEY('f'), 'n', 'e', 'e', 'd', 'l', 'e', '\r' };
+    for (size_t i = 0; i < searches; i++) {
+        add_key(trace, HOME, strlen(HOME));
+        for (size_t k = 0; k < sizeof(keys); k++) {
+            add_key(trace, &keys[k], 1);
+        }
+    }
+}
+
+// length of the key at the start of `keys`: a byte, an escape sequence or
+// a whole bracketed paste
+static size_t
+key_len(const char* keys, size_t len)
+{
+    size_t begin = strlen(PASTE_BEGIN);
+    if (len >= begin && !memcmp(keys, PASTE_BEGIN, begin)) {
+        const char* end = memmem(keys, len, PASTE_END, strlen(PASTE_END));
+        return end ? (size_t)(end - keys) + strlen(PASTE_END) : len;
+    } else if (len < 3 || keys[0] != '\x1b') {
+        return 1;
+    } else if (keys[1] == 'O') {
+        return 3;
+    } else if (keys[1] != '[') {
+        return 1;
+    }
+    size_t i = 2;
+    while (i < len && (keys[i] < '@' || keys[i] > '~')) {
+        i++;
+    }
+    return i < len ? i + 1 : len;
+}
+
+// a file of raw keystrokes, as recorded from a terminal
+static void
+trace_file(struct Trace* trace, const char* path)
+{
+    FILE* in = Fopen((char*)path, "r");
+    char buf[KILOBYTES(64)];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        append(trace, buf, n);
+    }
+    fclose(in);
+    for (size_t at = 0; at < trace->len;) {
+        at += key_len(&trace->keys[at], trace->len - at);
+        end_key(trace);
+        trace->ends[trace->count - 1] = at;
+    }
+}
+
+// keep the last TAIL bytes of the output in `tail`
+static void
+keep_tail(char* tail, size_t* tail_len, const char* buf, size_t n)
+{
+    if (n >= TAIL) {
+        memcpy(tail, &buf[n - TAIL], TAIL);
+        *tail_len = TAIL;
+        return;
+    }
+    if (*tail_len + n > TAIL) {
+        size_t drop = *tail_len + n - TAIL;
+        memmove(tail, &tail[drop], *tail_len - drop);
+        *tail_len -= drop;
+    }
+    memcpy(&tail[*tail_len], buf, n);
+    *tail_len += n;
+}
+
+// Run the editor on a pty and replay the trace once its first frame is
+// up, then quit it. Each key is sent once the frame for the one before it
+// has arrived, so every key is drawn. Frames and bytes are taken from the
+// stats the editor prints on exit. Returns -1 if it failed.
+static int
+run_trace(const char* texter, struct Trace* trace, struct Result* res)
+{
+    struct winsize ws = { .ws_row = ROWS, .ws_col = COLS };
+    int fd;
+    pid_t pid = forkpty(&fd, NULL, NULL, &ws);
+    if (pid == -1) {
+        unix_error("forkpty");
+    } else if (pid == 0) {
+        unsetenv("LINES");
+        unsetenv("COLUMNS");
+        execl(texter, texter, "--stats", trace->file, (char*)NULL);
+        perror(texter);
+        _exit(127);
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    char tail[TAIL];
+    size_t tail_len = 0;
+    char buf[KILOBYTES(64)];
+    size_t key = 0;  // the key being sent
+    size_t sent = 0; // bytes of the trace sent
+    int started = 0;
+    int waiting = 0; // for the frame of the last key sent
+    int quit = 0;
+    double start = 0;
+    while (1) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (started && !waiting && !quit) {
+            pfd.events |= POLLOUT;
+        }
+        if (poll(&pfd, 1, STALL_MS) < 1) {
+            fprintf(stderr, "%s: the editor stalled\n", trace->name);
+            kill(pid, SIGKILL);
+            break;
+        }
+        if (pfd.revents & POLLOUT) {
+            if (key < trace->count) {
+                ssize_t n =
+                  write(fd, &trace->keys[sent], trace->ends[key] - sent);
+                sent += n > 0 ? n : 0;
+                if (sent == trace->ends[key]) {
+                    key++;
+                    waiting = 1;
+                }
+            } else if (write(fd, (char[]){ CTRL_KEY('q') }, 1) == 1) {
+                quit = 1;
+            }
+        }
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n == 0 || (n == -1 && errno != EAGAIN)) {
+                // EIO once the editor has exited
+                break;
+            }
+            keep_tail(tail, &tail_len, buf, n > 0 ? n : 0);
+            size_t end = strlen(SHOW_CURSOR);
+            if (tail_len >= end &&
+                !memcmp(&tail[tail_len - end], SHOW_CURSOR, end)) {
+                waiting = 0;
+            }
+            if (!started && memmem(tail, tail_len, "HELP:", 5)) {
+                started = 1;
+                start = now();
+            }
+        }
+    }
+    res->secs = now() - start;
+    close(fd);
+    int status;
+    waitpid(pid, &status, 0);
+    char* stats = memmem(tail, tail_len, "frames: ", 8);
+    if (!started || !WIFEXITED(status) || WEXITSTATUS(status) || !stats ||
+        sscanf(stats,
+               "frames: %zu, bytes written: %zu",
+               &res->frames,
+               &res->bytes) != 2) {
+        fprintf(stderr, "%s: the editor failed\n", trace->name);
+        return -1;
+    }
+    return 0;
+}
+
+// a JSON string, escaped as needed
+static void
+json_str(FILE* out, const char* s)
+{
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(out, "\\%c", *s);
+        } else if ((unsigned char)*s < ' ') {
+            fprintf(out, "\\u%04x", *s);
+        } else {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void
+usage(const char* prog)
+{
+    fprintf(stderr,
+            "usage: %s [-e texter] [-s size] [-c label] [-o file] "
+            "[trace...]\n",
+            prog);
+    fprintf(stderr, "  -e  the editor to run, ./texter by default\n");
+    fprintf(stderr, "  -s  size of the file paged and searched, 64M\n");
+    fprintf(stderr, "  -c  label for the results, e.g. a commit\n");
+    fprintf(stderr, "  -o  write the results as JSON to file\n");
+    fprintf(stderr, "  traces are files of raw keys typed into a new file,\n");
+    fprintf(stderr, "  in place of the built in typing, paste, pgdown and\n");
+    fprintf(stderr, "  search traces\n");
+    exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char* argv[])
+{
+    const char* texter = "./texter";
+    const char* label = "";
+    const char* json = NULL;
+    size_t size = MEGABYTES(64);
+    int opt;
+    while ((opt = getopt(argc, argv, "e:s:c:o:")) != -1) {
+        switch (opt) {
+            case 'e':
+                texter = optarg;
+                break;
+            case 's':
+                size = parse_size(optarg);
+                break;
+            case 'c':
+                label = optarg;
+                break;
+            case 'o':
+                json = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    int n = optind < argc ? argc - optind : 4;
+    struct Trace* traces = Mem_calloc(MEM_OTHER, n, sizeof(*traces));
+    char* scratch = new_path();
+    char* big = NULL;
+    if (optind < argc) {
+        for (int i = 0; i < n; i++) {
+            traces[i].name = argv[optind + i];
+            traces[i].file = scratch;
+            trace_file(&traces[i], argv[optind + i]);
+        }
+    } else {
+        big = make_file(size);
+        traces[0] = (struct Trace){ .name = "typing", .file = scratch };
+        trace_typing(&traces[0], 20000);
+        traces[1] = (struct Trace){ .name = "paste", .file = scratch };
+        trace_paste(&traces[1], 64);
+        traces[2] = (struct Trace){ .name = "pgdown", .file = big };
+        trace_pgdown(&traces[2], size);
+        traces[3] = (struct Trace){ .name = "search", .file = big };
+        trace_search(&traces[3], 5);
+    }
+    FILE* out = json ? Fopen((char*)json, "w") : NULL;
+    if (out) {
+        fprintf(out, "{\n  \"label\": ");
+        json_str(out, label);
+        fprintf(out, ",\n  \"size\": %zu,\n  \"traces\": [", size);
+    }
+    int failed = 0;
+    int written = 0;
+    printf("%-10s %10s %12s %10s %12s %14s\n",
+           "trace",
+           "keys",
+           "ns/key",
+           "frames",
+           "frames/s",
+           "bytes/frame");
+    for (int i = 0; i < n; i++) {
+        struct Trace* trace = &traces[i];
+        struct Result res;
+        // edits are never saved, but start every trace on a fresh file
+        unlink(scratch);
+        if (run_trace(texter, trace, &res) == -1) {
+            failed = 1;
+            continue;
+        }
+        double ns_per_key = res.secs * 1e9 / trace->count;
+        double frames_per_sec = res.frames / res.secs;
+        double bytes_per_frame =
+          res.frames ? (double)res.bytes / res.frames : 0;
+        printf("%-10s %10zu %12.0f %10zu %12.1f %14.1f\n",
+               trace->name,
+               trace->count,
+               ns_per_key,
+               res.frames,
+               frames_per_sec,
+               bytes_per_frame);
+        if (out) {
+            fprintf(out, "%s\n    {\"name\": ", written++ ? "," : "");
+            json_str(out, trace->name);
+            fprintf(out,
+                    ", \"keys\": %zu, \"secs\": %.6f, \"ns_per_key\": %.1f, "
+                    "\"frames\": %zu, \"frames_per_sec\": %.1f, "
+                    "\"bytes\": %zu, \"bytes_per_frame\": %.1f}",
+                    trace->count,
+                    res.secs,
+                    ns_per_key,
+                    res.frames,
+                    frames_per_sec,
+                    res.bytes,
+                    bytes_per_frame);
+        }
+        Mem_free(MEM_OTHER, trace->keys, trace->cap);
+        Mem_free(MEM_OTHER,
+                 trace->ends,
+                 trace->ends_cap * sizeof(*trace->ends));
+    }
+    if (out) {
+        fprintf(out, "\n  ]\n}\n");
+        fclose(out);
+    }
+    if (big) {
+        unlink(big);
+        Mem_free(MEM_OTHER, big, PATH_LEN);
+    }
+    unlink(scratch);
+    Mem_free(MEM_OTHER, scratch, PATH_LEN);
+    Mem_free(MEM_OTHER, traces, n * sizeof(*traces));
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
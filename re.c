@@ -0,0 +1,908 @@
+#include "re.h"
+#include "gap.h"
+#include "mem.h"
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+
+// slots in a DFA's state table, kept at most half full
+#define RE_TABLE (2 * RE_MAX_STATES)
+
+/***** parsing *****/
+
+enum ReNodeType
+{
+    NODE_EMPTY,
+    NODE_CLASS,
+    NODE_CAT,
+    NODE_ALT,
+    NODE_STAR,
+    NODE_PLUS,
+    NODE_QUEST,
+    NODE_BEGIN,
+    NODE_END
+};
+
+struct ReNode
+{
+    int type;
+    struct ReNode* a;
+    struct ReNode* b;
+    unsigned char set[32]; // bytes a class matches, one bit each
+};
+
+struct ReParser
+{
+    const char* p;
+    const char* end;
+    const char* err;
+    struct BumpAlloc* arena;
+    int nodes;
+};
+
+static void
+set_add(unsigned char* set, unsigned char c)
+{
+    set[c / 8] |= 1 << (c % 8);
+}
+
+static int
+set_has(const unsigned char* set, unsigned char c)
+{
+    return set[c / 8] & (1 << (c % 8));
+}
+
+static struct ReNode*
+node(struct ReParser* p, int type, struct ReNode* a, struct ReNode* b)
+{
+    struct ReNode* n = Bump_alloc(p->arena, sizeof(*n));
+    n->type = type;
+    n->a = a;
+    n->b = b;
+    p->nodes++;
+    return n;
+}
+
+// add the bytes of a \d, \w or \s style escape to `set`. Returns 0 if `c`
+// is not one of them.
+static int
+escape_class(unsigned char* set, char c)
+{
+    unsigned char class[32] = { 0 };
+    switch (c | 0x20) {
+        case 'd':
+            for (int i = '0'; i <= '9'; i++) {
+                set_add(class, i);
+            }
+            break;
+        case 'w':
+            for (int i = 0; i < 256; i++) {
+                if ((i | 0x20) >= 'a' && (i | 0x20) <= 'z') {
+                    set_add(class, i);
+                }
+            }
+            for (int i = '0'; i <= '9'; i++) {
+                set_add(class, i);
+            }
+            set_add(class, '_');
+            break;
+        case 's':
+            for (const char* s = " \t\r\f\v"; *s; s++) {
+                set_add(class, *s);
+            }
+            break;
+        default:
+            return 0;
+    }
+    // upper case escapes match the bytes the lower case ones do not
+    int negate = c >= 'A' && c <= 'Z';
+    for (int i = 0; i < 32; i++) {
+        set[i] |= negate ? ~class[i] : class[i];
+    }
+    return 1;
+}
+
+static char
+escape_byte(char c)
+{
+    return c == 't' ? '\t' : c;
+}
+
+static struct ReNode*
+parse_class(struct ReParser* p)
+{
+    struct ReNode* n = node(p, NODE_CLASS, NULL, NULL);
+    int negate = p->p < p->end && *p->p == '^';
+    p->p += negate;
+    for (int first = 1; p->p < p->end && (first || *p->p != ']'); first = 0) {
+        unsigned char lo = *p->p++;
+        if (lo == '\\' && p->p < p->end) {
+            char c = *p->p++;
+            if (escape_class(n->set, c)) {
+                continue;
+            }
+            lo = escape_byte(c);
+        }
+        unsigned char hi = lo;
+        if (p->p + 1 < p->end && p->p[0] == '-' && p->p[1] != ']') {
+            hi = p->p[1];
+            p->p += 2;
+            if (hi == '\\' && p->p < p->end) {
+                hi = escape_byte(*p->p++);
+            }
+            if (hi < lo) {
+                p->err = "bad range in class";
+                return NULL;
+            }
+        }
+        for (int c = lo; c <= hi; c++) {
+            set_add(n->set, c);
+        }
+    }
+    if (p->p == p->end) {
+        p->err = "missing ]";
+        return NULL;
+    }
+    p->p++;
+    if (negate) {
+        for (int i = 0; i < 32; i++) {
+            n->set[i] = ~n->set[i];
+        }
+    }
+    return n;
+}
+
+static struct ReNode*
+parse_alt(struct ReParser* p);
+
+static struct ReNode*
+parse_atom(struct ReParser* p)
+{
+    char c = *p->p++;
+    struct ReNode* n;
+    switch (c) {
+        case '(':
+            n = parse_alt(p);
+            if (n && (p->p == p->end || *p->p++ != ')')) {
+                p->err = "missing )";
+                return NULL;
+            }
+            return n;
+        case '[':
+            return parse_class(p);
+        case '^':
+            return node(p, NODE_BEGIN, NULL, NULL);
+        case '$':
+            return node(p, NODE_END, NULL, NULL);
+        case '*':
+        case '+':
+        case '?':
+            p->err = "nothing to repeat";
+            return NULL;
+        case '.':
+            n = node(p, NODE_CLASS, NULL, NULL);
+            memset(n->set, 0xff, sizeof(n->set));
+            return n;
+        case '\\':
+            if (p->p == p->end) {
+                p->err = "trailing \\";
+                return NULL;
+            }
+            n = node(p, NODE_CLASS, NULL, NULL);
+            c = *p->p++;
+            if (!escape_class(n->set, c)) {
+                set_add(n->set, escape_byte(c));
+            }
+            return n;
+        default:
+            n = node(p, NODE_CLASS, NULL, NULL);
+            set_add(n->set, c);
+            return n;
+    }
+}
+
+static struct ReNode*
+parse_repeat(struct ReParser* p)
+{
+    struct ReNode* n = parse_atom(p);
+    while (n && p->p < p->end && strchr("*+?", *p->p)) {
+        int type = *p->p == '*' ? NODE_STAR
+                   : *p->p == '+' ? NODE_PLUS
+                                  : NODE_QUEST;
+        n = node(p, type, n, NULL);
+        p->p++;
+    }
+    return n;
+}
+
+static struct ReNode*
+parse_cat(struct ReParser* p)
+{
+    struct ReNode* left = NULL;
+    while (p->p < p->end && *p->p != '|' && *p->p != ')') {
+        struct ReNode* n = parse_repeat(p);
+        if (!n) {
+            return NULL;
+        }
+        left = left ? node(p, NODE_CAT, left, n) : n;
+    }
+    return left ? left : node(p, NODE_EMPTY, NULL, NULL);
+}
+
+static struct ReNode*
+parse_alt(struct ReParser* p)
+{
+    struct ReNode* left = parse_cat(p);
+    while (left && p->p < p->end && *p->p == '|') {
+        p->p++;
+        struct ReNode* right = parse_cat(p);
+        left = right ? node(p, NODE_ALT, left, right) : NULL;
+    }
+    return left;
+}
+
+/***** NFA *****/
+
+enum ReOp
+{
+    OP_CLASS, // read a byte in `set`, then go to `out`
+    OP_SPLIT, // go to both `out` and `out1`
+    OP_BEGIN, // go to `out` at the start of a line
+    OP_END,   // go to `out` at the end of a line
+    OP_MATCH
+};
+
+struct ReState
+{
+    int op;
+    int out, out1;
+    unsigned char set[32];
+};
+
+struct ReNfa
+{
+    struct ReState* states;
+    int n;
+    int start;
+};
+
+static int
+add_state(struct ReNfa* nfa, int op, int out, int out1)
+{
+    struct ReState* s = &nfa->states[nfa->n];
+    s->op = op;
+    s->out = out;
+    s->out1 = out1;
+    return nfa->n++;
+}
+
+// Thompson's construction, built back to front: each node is compiled
+// knowing the state that follows it. The reversed NFA matches the text
+// read backwards, so concatenations run the other way and line starts
+// and ends trade places.
+static int
+compile(struct ReNfa* nfa, struct ReNode* n, int next, int reverse)
+{
+    int s;
+    switch (n->type) {
+        case NODE_CLASS:
+            s = add_state(nfa, OP_CLASS, next, -1);
+            memcpy(nfa->states[s].set, n->set, sizeof(n->set));
+            // matches stay on one line
+            nfa->states[s].set['\n' / 8] &= ~(1 << ('\n' % 8));
+            return s;
+        case NODE_CAT:
+            if (reverse) {
+                return compile(nfa, n->b, compile(nfa, n->a, next, 1), 1);
+            }
+            return compile(nfa, n->a, compile(nfa, n->b, next, 0), 0);
+        case NODE_ALT:
+            s = compile(nfa, n->a, next, reverse);
+            return add_state(
+              nfa, OP_SPLIT, s, compile(nfa, n->b, next, reverse));
+        case NODE_STAR:
+        case NODE_PLUS:
+            s = add_state(nfa, OP_SPLIT, -1, next);
+            nfa->states[s].out = compile(nfa, n->a, s, reverse);
+            return n->type == NODE_STAR ? s : nfa->states[s].out;
+        case NODE_QUEST:
+            return add_state(
+              nfa, OP_SPLIT, compile(nfa, n->a, next, reverse), next);
+        case NODE_BEGIN:
+            return add_state(nfa, reverse ? OP_END : OP_BEGIN, next, -1);
+        case NODE_END:
+            return add_state(nfa, reverse ? OP_BEGIN : OP_END, next, -1);
+        default:
+            return next;
+    }
+}
+
+/***** DFA *****/
+
+// a set of NFA states, and where each byte leads from it once looked up
+struct ReDfaState
+{
+    struct ReDfaState* next[256];
+    int match;     // the set holds a match
+    int match_end; // a match is reached at the end of a line
+    int match_empty; // or at the end of an empty line
+    int dead;      // nothing can match from here
+    int n;
+    int nfa[];
+};
+
+// A DFA whose states are made the first time they are reached. Once it
+// has RE_MAX_STATES states they are all thrown away and made again as
+// needed, so memory stays bounded and each byte still costs at most one
+// pass over the NFA.
+struct ReDfa
+{
+    struct ReNfa* nfa;
+    int anchored; // only match from where the scan starts
+    struct BumpAlloc* arena;
+    struct BumpMark mark;
+    struct ReDfaState** table;
+    int count;
+    unsigned flushes;
+    struct ReDfaState* start[2]; // mid line, at a line start
+};
+
+// Where matches start in a part of a line read backwards, one bit per
+// offset in [from, to]. The matches of a line are usually walked in turn,
+// and the starts found for the first one serve the rest, so the line is
+// read backwards once rather than once per match.
+struct ReStarts
+{
+    struct GapBuffer* gap;
+    size_t edits; // gap->edits when they were found
+    ssize_t from;
+    ssize_t to;
+    uint64_t* bits;
+    size_t words; // room in bits
+};
+
+struct Regex
+{
+    struct BumpAlloc* arena;
+    struct ReNfa fwd, rev;
+    struct ReDfa search;   // forward, unanchored: which line matches first
+    struct ReDfa longest;  // forward, anchored: how far a match goes
+    struct ReDfa backward; // reversed, unanchored: where matches start
+    size_t states;         // room for NFA states, in each of fwd and rev
+    int* list;             // scratch for building a state
+    int* stack;
+    unsigned* seen;
+    unsigned gen;
+    struct ReStarts starts;
+};
+
+// add the states reachable from `s` without reading a byte to re->list.
+// Line ends are only passed at the end of a line, otherwise they are
+// listed, to be followed if the line ends there.
+static void
+closure(struct Regex* re,
+        struct ReNfa* nfa,
+        int s,
+        int at_begin,
+        int at_end,
+        int* n)
+{
+    int top = 0;
+    re->stack[top++] = s;
+    while (top) {
+        s = re->stack[--top];
+        if (s < 0 || re->seen[s] == re->gen) {
+            continue;
+        }
+        re->seen[s] = re->gen;
+        struct ReState* st = &nfa->states[s];
+        switch (st->op) {
+            case OP_SPLIT:
+                re->stack[top++] = st->out1;
+                re->stack[top++] = st->out;
+                break;
+            case OP_BEGIN:
+                if (at_begin) {
+                    re->stack[top++] = st->out;
+                }
+                break;
+            case OP_END:
+                if (at_end) {
+                    re->stack[top++] = st->out;
+                    break;
+                }
+                re->list[(*n)++] = s;
+                break;
+            default:
+                re->list[(*n)++] = s;
+                break;
+        }
+    }
+}
+
+static void
+dfa_init(struct ReDfa* dfa, struct ReNfa* nfa, int anchored)
+{
+    dfa->nfa = nfa;
+    dfa->anchored = anchored;
+    dfa->arena = Bump_new(KILOBYTES((size_t)256), MEM_SCRATCH);
+    dfa->table = Bump_alloc(dfa->arena, sizeof(*dfa->table) * RE_TABLE);
+    dfa->mark = Bump_mark(dfa->arena);
+    dfa->count = 0;
+    dfa->flushes = 0;
+    dfa->start[0] = dfa->start[1] = NULL;
+}
+
+static void
+dfa_flush(struct ReDfa* dfa)
+{
+    Bump_reset(dfa->arena, dfa->mark);
+    memset(dfa->table, 0, sizeof(*dfa->table) * RE_TABLE);
+    dfa->count = 0;
+    dfa->flushes++;
+    dfa->start[0] = dfa->start[1] = NULL;
+}
+
+static int
+compare_int(const void* a, const void* b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+// the DFA state for the first `n` NFA states in re->list
+static struct ReDfaState*
+dfa_state(struct Regex* re, struct ReDfa* dfa, int n)
+{
+    int* list = re->list;
+    qsort(list, n, sizeof(*list), compare_int);
+    unsigned hash = 2166136261u;
+    for (int i = 0; i < n; i++) {
+        hash = (hash ^ list[i]) * 16777619u;
+    }
+    unsigned slot = hash % RE_TABLE;
+    for (struct ReDfaState* d; (d = dfa->table[slot]);) {
+        if (d->n == n && !memcmp(d->nfa, list, sizeof(*list) * n)) {
+            return d;
+        }
+        slot = (slot + 1) % RE_TABLE;
+    }
+    if (dfa->count == RE_MAX_STATES) {
+        dfa_flush(dfa);
+        slot = hash % RE_TABLE;
+        while (dfa->table[slot]) {
+            slot = (slot + 1) % RE_TABLE;
+        }
+    }
+    struct ReDfaState* d =
+      Bump_alloc(dfa->arena, sizeof(*d) + sizeof(*list) * n);
+    memcpy(d->nfa, list, sizeof(*list) * n);
+    d->n = n;
+    d->dead = !n;
+    struct ReNfa* nfa = dfa->nfa;
+    for (int i = 0; i < n; i++) {
+        d->match |= nfa->states[list[i]].op == OP_MATCH;
+    }
+    // on an empty line, line starts can be passed after the line end
+    for (int empty = 0; empty < 2; empty++) {
+        int ends = n;
+        re->gen++;
+        for (int i = 0; i < n; i++) {
+            struct ReState* s = &nfa->states[list[i]];
+            if (s->op == OP_END) {
+                closure(re, nfa, s->out, empty, 1, &ends);
+            }
+        }
+        int match = d->match;
+        for (int i = n; i < ends; i++) {
+            match |= nfa->states[list[i]].op == OP_MATCH;
+        }
+        *(empty ? &d->match_empty : &d->match_end) = match;
+    }
+    dfa->table[slot] = d;
+    dfa->count++;
+    return d;
+}
+
+static struct ReDfaState*
+dfa_start(struct Regex* re, struct ReDfa* dfa, int at_begin)
+{
+    if (!dfa->start[at_begin]) {
+        int n = 0;
+        re->gen++;
+        closure(re, dfa->nfa, dfa->nfa->start, at_begin, 0, &n);
+        struct ReDfaState* d = dfa_state(re, dfa, n);
+        dfa->start[at_begin] = d;
+    }
+    return dfa->start[at_begin];
+}
+
+static struct ReDfaState*
+dfa_step(struct Regex* re,
+         struct ReDfa* dfa,
+         struct ReDfaState* d,
+         unsigned char c)
+{
+    if (d->next[c]) {
+        return d->next[c];
+    }
+    struct ReNfa* nfa = dfa->nfa;
+    int n = 0;
+    re->gen++;
+    for (int i = 0; i < d->n; i++) {
+        struct ReState* s = &nfa->states[d->nfa[i]];
+        if (s->op == OP_CLASS && set_has(s->set, c)) {
+            closure(re, nfa, s->out, 0, 0, &n);
+        }
+    }
+    if (!dfa->anchored) {
+        closure(re, nfa, nfa->start, 0, 0, &n);
+    }
+    unsigned flushes = dfa->flushes;
+    struct ReDfaState* next = dfa_state(re, dfa, n);
+    // a flush frees `d` along with every other state
+    if (flushes == dfa->flushes) {
+        d->next[c] = next;
+    }
+    return next;
+}
+
+struct Regex*
+Re_compile(const char* pat, ssize_t len, const char** err)
+{
+    struct BumpAlloc* arena = Bump_new(KILOBYTES((size_t)16), MEM_SCRATCH);
+    struct BumpMark mark = Bump_mark(arena);
+    struct ReParser p = {
+        .p = pat, .end = pat + len, .err = NULL, .arena = arena, .nodes = 0
+    };
+    struct ReNode* tree = parse_alt(&p);
+    if (tree && p.p < p.end) {
+        p.err = "unmatched )";
+    }
+    if (p.err) {
+        *err = p.err;
+        Bump_free(arena);
+        return NULL;
+    }
+    struct Regex* re = Mem_alloc(MEM_SCRATCH, sizeof(*re));
+    re->arena = arena;
+    // a state per node at most, and the match
+    size_t states = p.nodes + 1;
+    re->states = states;
+    struct ReState* fwd = Mem_alloc(MEM_SCRATCH, sizeof(*fwd) * states);
+    struct ReState* rev = Mem_alloc(MEM_SCRATCH, sizeof(*rev) * states);
+    re->fwd = (struct ReNfa){ .states = fwd, .n = 0 };
+    re->rev = (struct ReNfa){ .states = rev, .n = 0 };
+    int match = add_state(&re->fwd, OP_MATCH, -1, -1);
+    re->fwd.start = compile(&re->fwd, tree, match, 0);
+    match = add_state(&re->rev, OP_MATCH, -1, -1);
+    re->rev.start = compile(&re->rev, tree, match, 1);
+    // the tree is not needed once compiled
+    Bump_reset(arena, mark);
+    // a state can be listed twice while looking for matches at line ends
+    re->list = Bump_alloc(arena, sizeof(*re->list) * 2 * states);
+    re->stack = Bump_alloc(arena, sizeof(*re->stack) * (2 * states + 1));
+    re->seen = Bump_alloc(arena, sizeof(*re->seen) * states);
+    re->gen = 0;
+    re->starts.gap = NULL;
+    re->starts.bits = NULL;
+    re->starts.words = 0;
+    dfa_init(&re->search, &re->fwd, 0);
+    dfa_init(&re->longest, &re->fwd, 1);
+    dfa_init(&re->backward, &re->rev, 0);
+    *err = NULL;
+    return re;
+}
+
+void
+Re_free(struct Regex* re)
+{
+    Bump_free(re->search.arena);
+    Bump_free(re->longest.arena);
+    Bump_free(re->backward.arena);
+    Mem_free(MEM_SCRATCH, re->fwd.states, sizeof(struct ReState) * re->states);
+    Mem_free(MEM_SCRATCH, re->rev.states, sizeof(struct ReState) * re->states);
+    Mem_free(MEM_SCRATCH,
+             re->starts.bits,
+             sizeof(*re->starts.bits) * re->starts.words);
+    Bump_free(re->arena);
+    Mem_free(MEM_SCRATCH, re, sizeof(*re));
+}
+
+/***** matching *****/
+
+// whether `d` holds a match at the end of a line, which is empty if `empty`
+static int
+ends_line(struct ReDfaState* d, int empty)
+{
+    return empty ? d->match_empty : d->match_end;
+}
+
+static int
+byte_at(struct GapBuffer* gap, ssize_t offset)
+{
+    struct iovec iov[2];
+    if (offset < 0 || !Gap_iov(gap, offset, offset + 1, iov)) {
+        return -1;
+    }
+    return *(unsigned char*)iov[0].iov_base;
+}
+
+static int
+line_start(struct GapBuffer* gap, ssize_t offset)
+{
+    return offset <= 0 || byte_at(gap, offset - 1) == '\n';
+}
+
+static int
+line_end(struct GapBuffer* gap, ssize_t offset)
+{
+    return offset >= gap->size || byte_at(gap, offset) == '\n';
+}
+
+// where matching stops: the empty line after a final newline is not a
+// line, as in sed and grep
+static ssize_t
+text_end(struct GapBuffer* gap)
+{
+    ssize_t end = gap->size;
+    return end > 0 && byte_at(gap, end - 1) == '\n' ? end - 1 : end;
+}
+
+// offset of the first '\n' in [from, to), or `to`
+static ssize_t
+find_newline(struct GapBuffer* gap, ssize_t from, ssize_t to)
+{
+    struct iovec iov[2];
+    int n = Gap_iov(gap, from, to, iov);
+    for (int i = 0; i < n; i++) {
+        const char* nl = memchr(iov[i].iov_base, '\n', iov[i].iov_len);
+        if (nl) {
+            return from + (nl - (char*)iov[i].iov_base);
+        }
+        from += iov[i].iov_len;
+    }
+    return to;
+}
+
+// Start of the first line in [from, to) to hold a match, or -1. The scan
+// stops as soon as any match ends, which pins down the line. Where it
+// stopped on the line is put in *stop.
+static ssize_t
+first_line(struct Regex* re,
+           struct GapBuffer* gap,
+           ssize_t from,
+           ssize_t to,
+           ssize_t* stop)
+{
+    struct ReDfa* dfa = &re->search;
+    struct ReDfaState* d = dfa_start(re, dfa, line_start(gap, from));
+    ssize_t line = from;
+    ssize_t off = from;
+    struct iovec iov[2];
+    int n = Gap_iov(gap, from, to, iov);
+    for (int k = 0; k < n && !d->match; k++) {
+        const unsigned char* text = iov[k].iov_base;
+        ssize_t len = iov[k].iov_len;
+        for (ssize_t i = 0; i < len; i++) {
+            // the usual case: a known state that is not a match. No state
+            // has a known next state for '\n'.
+            struct ReDfaState* next = d->next[text[i]];
+            if (next && !next->match) {
+                d = next;
+            } else if (text[i] != '\n') {
+                d = dfa_step(re, dfa, d, text[i]);
+                if (d->match) {
+                    off += i + 1;
+                    break;
+                }
+            } else if (ends_line(d, line == off + i && line_start(gap, line))) {
+                *stop = off + i;
+                return line;
+            } else {
+                line = off + i + 1;
+                d = dfa_start(re, dfa, 1);
+                if (d->match) {
+                    off += i + 1;
+                    break;
+                }
+            }
+        }
+        off += d->match ? 0 : len;
+    }
+    int empty = line == to && line_start(gap, to);
+    if (d->match || (ends_line(d, empty) && line_end(gap, to))) {
+        *stop = off;
+        return line;
+    }
+    return -1;
+}
+
+// Record where matches start in [from, to], a part of one line, by running
+// the reversed expression backwards from `to` once.
+static void
+find_starts(struct Regex* re, struct GapBuffer* gap, ssize_t from, ssize_t to)
+{
+    struct ReStarts* starts = &re->starts;
+    size_t words = (to - from) / 64 + 1;
+    if (words > starts->words) {
+        Mem_free(MEM_SCRATCH,
+                 starts->bits,
+                 sizeof(*starts->bits) * starts->words);
+        starts->bits = Mem_alloc(MEM_SCRATCH, sizeof(*starts->bits) * words);
+        starts->words = words;
+    }
+    memset(starts->bits, 0, sizeof(*starts->bits) * words);
+    starts->gap = gap;
+    starts->edits = gap->edits;
+    starts->from = from;
+    starts->to = to;
+    struct ReDfa* dfa = &re->backward;
+    struct ReDfaState* d = dfa_start(re, dfa, line_end(gap, to));
+    uint64_t* bits = starts->bits;
+    if (d->match) {
+        bits[(to - from) / 64] |= (uint64_t)1 << (to - from) % 64;
+    }
+    struct iovec iov[2];
+    int n = Gap_iov(gap, from, to, iov);
+    ssize_t i = to - from;
+    for (int k = n - 1; k >= 0; k--) {
+        const unsigned char* text = iov[k].iov_base;
+        for (ssize_t j = iov[k].iov_len - 1; j >= 0; j--) {
+            d = dfa_step(re, dfa, d, text[j]);
+            i--;
+            if (d->match) {
+                bits[i / 64] |= (uint64_t)1 << i % 64;
+            }
+        }
+    }
+    int empty = from == to && line_end(gap, to);
+    if (ends_line(d, empty) && line_start(gap, from)) {
+        bits[0] |= 1;
+    }
+}
+
+// the first recorded start at or after `at`, or -1
+static ssize_t
+next_start(struct ReStarts* starts, ssize_t at)
+{
+    size_t i = at - starts->from;
+    size_t last = (starts->to - starts->from) / 64;
+    size_t w = i / 64;
+    uint64_t bits = starts->bits[w] & (~(uint64_t)0 << i % 64);
+    while (!bits) {
+        if (w++ == last) {
+            return -1;
+        }
+        bits = starts->bits[w];
+    }
+    return starts->from + w * 64 + __builtin_ctzll(bits);
+}
+
+// end of the longest match starting at `from`, up to the end of its line
+// or `to`
+static ssize_t
+longest_end(struct Regex* re, struct GapBuffer* gap, ssize_t from, ssize_t to)
+{
+    struct ReDfa* dfa = &re->longest;
+    struct ReDfaState* d = dfa_start(re, dfa, line_start(gap, from));
+    ssize_t end = d->match ? from : -1;
+    struct iovec iov[2];
+    int n = Gap_iov(gap, from, to, iov);
+    ssize_t off = from;
+    for (int k = 0; k < n && !d->dead; k++) {
+        const unsigned char* text = iov[k].iov_base;
+        ssize_t len = iov[k].iov_len;
+        ssize_t i = 0;
+        for (; i < len && text[i] != '\n'; i++) {
+            d = dfa_step(re, dfa, d, text[i]);
+            if (d->dead) {
+                break;
+            } else if (d->match) {
+                end = off + i + 1;
+            }
+        }
+        off += i;
+        if (i < len) {
+            break;
+        }
+    }
+    int empty = off == from && line_start(gap, from);
+    if (ends_line(d, empty) && line_end(gap, off)) {
+        end = off;
+    }
+    return end;
+}
+
+// Offset of the leftmost match lying within [from, to), or -1. Its end,
+// for the longest match starting there, is put in *end. One forward pass
+// finds the line, then that line is read backwards once for where its
+// matches start, which later calls on the same line reuse. Nothing
+// matches after a final newline, see text_end.
+ssize_t
+Re_first(struct Regex* re,
+         struct GapBuffer* gap,
+         ssize_t from,
+         ssize_t to,
+         ssize_t* end)
+{
+    if (to > text_end(gap)) {
+        to = text_end(gap);
+    }
+    if (from > to) {
+        return -1;
+    }
+    ssize_t stop;
+    ssize_t line = first_line(re, gap, from, to, &stop);
+    if (line == -1) {
+        return -1;
+    }
+    // the line ends where the starts found last end, if they cover it
+    struct ReStarts* starts = &re->starts;
+    ssize_t eol;
+    if (starts->gap == gap && starts->edits == gap->edits &&
+        line >= starts->from && stop <= starts->to &&
+        (to == starts->to || (to > starts->to && line_end(gap, starts->to)))) {
+        eol = starts->to;
+    } else {
+        eol = find_newline(gap, stop, to);
+        find_starts(re, gap, line, eol);
+    }
+    ssize_t start = next_start(starts, line);
+    if (start == -1) {
+        return -1;
+    }
+    *end = longest_end(re, gap, start, eol);
+    return start;
+}
+
+// Offset of the last match starting within [from, to), or -1. The text is
+// read backwards from the end of the line holding `to`, so the first start
+// seen is the one wanted.
+ssize_t
+Re_last(struct Regex* re,
+        struct GapBuffer* gap,
+        ssize_t from,
+        ssize_t to,
+        ssize_t* end)
+{
+    if (to > gap->size) {
+        to = gap->size;
+    }
+    if (from >= to) {
+        return -1;
+    }
+    struct ReDfa* dfa = &re->backward;
+    ssize_t off = find_newline(gap, to, gap->size);
+    ssize_t line = off;
+    struct ReDfaState* d = dfa_start(re, dfa, 1);
+    ssize_t start = d->match && off < to ? off : -1;
+    struct iovec iov[2];
+    int n = Gap_iov(gap, from, off, iov);
+    for (int k = n - 1; k >= 0 && start == -1; k--) {
+        const unsigned char* text = iov[k].iov_base;
+        for (ssize_t i = iov[k].iov_len - 1; i >= 0; i--) {
+            off--;
+            if (text[i] != '\n') {
+                d = dfa_step(re, dfa, d, text[i]);
+            } else if (ends_line(d, off + 1 == line) && off + 1 < to) {
+                start = off + 1;
+                break;
+            } else {
+                line = off;
+                d = dfa_start(re, dfa, 1);
+            }
+            if (d->match && off < to) {
+                start = off;
+                break;
+            }
+        }
+    }
+    if (start == -1 && ends_line(d, from == line) && line_start(gap, from) &&
+        from < to) {
+        start = from;
+    }
+    if (start != -1) {
+        *end = longest_end(re, gap, start, line);
+    }
+    return start;
+}
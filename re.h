@@ -0,0 +1,37 @@
+#ifndef REGEX
+#define REGEX
+#include <sys/types.h>
+
+// DFA states cached per automaton before the cache is flushed
+#define RE_MAX_STATES (1024)
+
+struct GapBuffer;
+struct Regex;
+
+// Regular expressions matched by DFAs built lazily from a Thompson NFA, so
+// the time taken is linear in the text searched. Matches never span lines:
+// `.` and classes do not match '\n', and `^` and `$` match at line
+// boundaries. As in sed and grep, text ending in '\n' has no empty last
+// line for anything to match on. The syntax is . [] [^] * + ? | () ^ $ and
+// the escapes \d \w \s \D \W \S \t. Any other escaped byte stands for
+// itself.
+struct Regex*
+Re_compile(const char* pat, ssize_t len, const char** err);
+
+void
+Re_free(struct Regex* re);
+
+ssize_t
+Re_first(struct Regex* re,
+         struct GapBuffer* gap,
+         ssize_t from,
+         ssize_t to,
+         ssize_t* end);
+
+ssize_t
+Re_last(struct Regex* re,
+        struct GapBuffer* gap,
+        ssize_t from,
+        ssize_t to,
+        ssize_t* end);
+#endif // !REGEX
@@ -0,0 +1,141 @@
+#include "render.h"
+#include "gap.h"
+#include "mem.h"
+
+// bytes of a line rendered at a time
+#define RENDER_CHUNK (4096)
+
+struct RenderCache*
+Render_new(ssize_t slots)
+{
+    struct RenderCache* cache = Mem_alloc(MEM_RENDER, sizeof(*cache));
+    cache->slots = slots;
+    cache->lines = Mem_calloc(MEM_RENDER, slots, sizeof(*cache->lines));
+    for (ssize_t i = 0; i < slots; i++) {
+        cache->lines[i].line = -1;
+    }
+    return cache;
+}
+
+void
+Render_free(struct RenderCache* cache)
+{
+    for (ssize_t i = 0; i < cache->slots; i++) {
+        struct RenderLine* r = &cache->lines[i];
+        Mem_free(MEM_RENDER, r->text, r->text_cap);
+        Mem_free(MEM_RENDER, r->rx, r->rx_cap * sizeof(*r->rx));
+    }
+    Mem_free(MEM_RENDER, cache->lines, cache->slots * sizeof(*cache->lines));
+    Mem_free(MEM_RENDER, cache, sizeof(*cache));
+}
+
+// `line` was edited and `delta` lines were inserted after it, or removed if
+// negative. Lines after an edit that adds or removes lines have moved, so
+// they are dropped as well.
+void
+Render_edit(struct RenderCache* cache, ssize_t line, ssize_t delta)
+{
+    if (delta == 0) {
+        struct RenderLine* r = &cache->lines[line % cache->slots];
+        if (r->line == line) {
+            r->line = -1;
+        }
+        return;
+    }
+    for (ssize_t i = 0; i < cache->slots; i++) {
+        if (cache->lines[i].line >= line) {
+            cache->lines[i].line = -1;
+        }
+    }
+}
+
+static void
+reserve(struct RenderLine* r, ssize_t more)
+{
+    ssize_t text_need = r->len + more * TABWIDTH;
+    if (text_need > r->text_cap) {
+        ssize_t cap = text_need > 2 * r->text_cap ? text_need : 2 * r->text_cap;
+        r->text = Mem_realloc(MEM_RENDER, r->text, r->text_cap, cap);
+        r->text_cap = cap;
+    }
+    ssize_t rx_need = r->bytes + more + 1;
+    if (rx_need > r->rx_cap) {
+        ssize_t cap = rx_need > 2 * r->rx_cap ? rx_need : 2 * r->rx_cap;
+        r->rx = Mem_realloc(MEM_RENDER,
+                            r->rx,
+                            r->rx_cap * sizeof(*r->rx),
+                            cap * sizeof(*r->rx));
+        r->rx_cap = cap;
+    }
+}
+
+// render the next chunk of the line
+static void
+render_more(struct RenderLine* r, struct GapBuffer* gap)
+{
+    char chunk[RENDER_CHUNK + 1];
+    ssize_t line_len = Gap_line_len(gap, r->line);
+    ssize_t n = line_len - r->bytes;
+    if (n > RENDER_CHUNK) {
+        n = RENDER_CHUNK;
+    }
+    ssize_t start = Gap_line_start(gap, r->line) + r->bytes;
+    Gap_substr(gap, start, start + n, chunk);
+    reserve(r, n);
+    for (ssize_t i = 0; i < n; i++) {
+        r->rx[r->bytes + i] = r->len;
+        if (chunk[i] == '\t') {
+            do {
+                r->text[r->len++] = ' ';
+            } while (r->len % TABWIDTH);
+        } else {
+            r->text[r->len++] = chunk[i];
+        }
+    }
+    r->bytes += n;
+    r->rx[r->bytes] = r->len;
+    r->done = r->bytes == line_len;
+}
+
+static struct RenderLine*
+lookup(struct RenderCache* cache, ssize_t line)
+{
+    struct RenderLine* r = &cache->lines[line % cache->slots];
+    if (r->line != line) {
+        r->line = line;
+        r->bytes = 0;
+        r->len = 0;
+        r->done = 0;
+        reserve(r, 0);
+        r->rx[0] = 0;
+    }
+    return r;
+}
+
+// the rendered line, covering at least the first `rx_end` columns
+struct RenderLine*
+Render_line(struct RenderCache* cache,
+            struct GapBuffer* gap,
+            ssize_t line,
+            ssize_t rx_end)
+{
+    struct RenderLine* r = lookup(cache, line);
+    while (!r->done && r->len < rx_end) {
+        render_more(r, gap);
+    }
+    return r;
+}
+
+// the column byte `cx` of the line is drawn at
+ssize_t
+Render_rx(struct RenderCache* cache,
+          struct GapBuffer* gap,
+          ssize_t line,
+          ssize_t cx)
+{
+    struct RenderLine* r = lookup(cache, line);
+    while (!r->done && r->bytes < cx) {
+        render_more(r, gap);
+    }
+    return r->rx[cx < r->bytes ? cx : r->bytes];
+}
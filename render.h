@@ -0,0 +1,50 @@
+#ifndef RENDER
+#define RENDER
+#include <sys/types.h>
+
+#define TABWIDTH (4)
+
+struct GapBuffer;
+
+// a line as it is drawn, with tabs expanded to the next tab stop. Long
+// lines are rendered a chunk at a time, only as far as they are looked at.
+struct RenderLine
+{
+    ssize_t line; // -1 for an empty slot
+    ssize_t bytes; // bytes of the line rendered so far
+    int done;      // whether the whole line is rendered
+    ssize_t len;   // length of the rendered text
+    char* text;
+    ssize_t* rx; // rx[cx] is the column byte cx is drawn at, for cx <= bytes
+    ssize_t text_cap, rx_cap;
+};
+
+// Rendered lines, kept until the line is edited. Slots are picked by line
+// number, so any `slots` consecutive lines can be cached at once.
+struct RenderCache
+{
+    ssize_t slots;
+    struct RenderLine* lines;
+};
+
+struct RenderCache*
+Render_new(ssize_t slots);
+
+void
+Render_free(struct RenderCache* cache);
+
+void
+Render_edit(struct RenderCache* cache, ssize_t line, ssize_t delta);
+
+struct RenderLine*
+Render_line(struct RenderCache* cache,
+            struct GapBuffer* gap,
+            ssize_t line,
+            ssize_t rx_end);
+
+ssize_t
+Render_rx(struct RenderCache* cache,
+          struct GapBuffer* gap,
+          ssize_t line,
+          ssize_t cx);
+#endif // !RENDER
@@ -0,0 +1,161 @@
+#include "replace.h"
+#include "gap.h"
+#include "mem.h"
+#include "re.h"
+#include "search.h"
+#include "util.h"
+#include "work.h"
+#include <string.h>
+#include <sys/uio.h>
+
+// smallest chunk of text worth searching on a thread of its own
+#define REPLACE_CHUNK (MEGABYTES(1))
+
+// the matches found in [from, to)
+struct ReplaceChunk
+{
+    struct Replace* rep;
+    struct GapBuffer* gap;
+    const struct Search* search;
+    ssize_t from, to;
+    struct GapEdit* edits;
+    ssize_t count, cap;
+};
+
+// offset just past the first newline at or after `at`, or the end of the
+// text if there is none
+static ssize_t
+line_after(struct GapBuffer* gap, ssize_t at)
+{
+    struct iovec iov[2];
+    int n = Gap_iov(gap, at, gap->size, iov);
+    for (int i = 0; i < n; i++) {
+        const char* nl = memchr(iov[i].iov_base, '\n', iov[i].iov_len);
+        if (nl) {
+            return at + (nl - (char*)iov[i].iov_base) + 1;
+        }
+        at += iov[i].iov_len;
+    }
+    return gap->size;
+}
+
+static void
+add_match(struct ReplaceChunk* chunk, ssize_t at, ssize_t end)
+{
+    if (chunk->count == chunk->cap) {
+        ssize_t cap = chunk->cap ? 2 * chunk->cap : 64;
+        chunk->edits = Mem_realloc(MEM_SCRATCH,
+                                   chunk->edits,
+                                   chunk->cap * sizeof(struct GapEdit),
+                                   cap * sizeof(struct GapEdit));
+        chunk->cap = cap;
+    }
+    chunk->edits[chunk->count++] = (struct GapEdit){
+        at, end - at, chunk->rep->with, chunk->rep->with_len
+    };
+}
+
+// find the matches in one chunk. A regex keeps the DFA states it builds,
+// so every chunk compiles its own.
+static void
+Replace_chunk(void* arg, int job)
+{
+    struct ReplaceChunk* chunk = &((struct ReplaceChunk*)arg)[job];
+    struct Replace* rep = chunk->rep;
+    struct GapBuffer* gap = chunk->gap;
+    struct Regex* re = NULL;
+    const char* err;
+    if (rep->regex && !(re = Re_compile(rep->pat, rep->len, &err))) {
+        return;
+    }
+    ssize_t at = chunk->from;
+    ssize_t last = -1;
+    while (at <= chunk->to) {
+        ssize_t end;
+        ssize_t m;
+        if (re) {
+            m = Re_first(re, gap, at, chunk->to, &end);
+        } else {
+            m = Search_first(chunk->search, gap, at, chunk->to);
+            end = m + rep->len;
+        }
+        // an empty match at the end of the chunk belongs to the next one
+        if (m == -1 || (m == chunk->to && m < gap->size)) {
+            break;
+        }
+        if (end > m || m != last) {
+            add_match(chunk, m, end);
+        }
+        last = end;
+        at = end > m ? end : m + 1;
+    }
+    if (re) {
+        Re_free(re);
+    }
+}
+
+// find every match, in order, in rep->edits. Returns how many there are.
+ssize_t
+Replace_find(struct Replace* rep, struct GapBuffer* gap, struct WorkPool* pool)
+{
+    struct Search search;
+    if (!rep->regex) {
+        Search_init(&search, rep->pat, rep->len);
+    }
+    int jobs = 1;
+    // a literal with a newline in it could match across a cut
+    if (pool && (rep->regex || !memchr(rep->pat, '\n', rep->len))) {
+        jobs = Work_threads(pool) * 4;
+        if (jobs > gap->size / REPLACE_CHUNK) {
+            jobs = gap->size / REPLACE_CHUNK;
+        }
+        jobs = jobs < 1 ? 1 : jobs;
+    }
+    size_t chunks_size = sizeof(struct ReplaceChunk) * jobs;
+    struct ReplaceChunk* chunks = Mem_calloc(MEM_SCRATCH, 1, chunks_size);
+    ssize_t from = 0;
+    for (int job = 0; job < jobs; job++) {
+        ssize_t to = gap->size;
+        if (job + 1 < jobs) {
+            to = line_after(gap, gap->size / jobs * (job + 1));
+            to = to < from ? from : to;
+        }
+        chunks[job].rep = rep;
+        chunks[job].gap = gap;
+        chunks[job].search = &search;
+        chunks[job].from = from;
+        chunks[job].to = to;
+        from = to;
+    }
+    if (jobs > 1) {
+        Work_run(pool, Replace_chunk, chunks, jobs);
+    } else {
+        Replace_chunk(chunks, 0);
+    }
+    rep->count = 0;
+    for (int job = 0; job < jobs; job++) {
+        rep->count += chunks[job].count;
+    }
+    size_t edit_size = sizeof(struct GapEdit);
+    rep->edits =
+      rep->count ? Mem_alloc(MEM_SCRATCH, rep->count * edit_size) : NULL;
+    ssize_t n = 0;
+    for (int job = 0; job < jobs; job++) {
+        struct ReplaceChunk* chunk = &chunks[job];
+        if (chunk->count) {
+            memcpy(&rep->edits[n], chunk->edits, chunk->count * edit_size);
+        }
+        n += chunk->count;
+        Mem_free(MEM_SCRATCH, chunk->edits, chunk->cap * edit_size);
+    }
+    Mem_free(MEM_SCRATCH, chunks, chunks_size);
+    return rep->count;
+}
+
+void
+Replace_free(struct Replace* rep)
+{
+    Mem_free(MEM_SCRATCH, rep->edits, rep->count * sizeof(struct GapEdit));
+    rep->edits = NULL;
+    rep->count = 0;
+}
@@ -0,0 +1,30 @@
+#ifndef REPLACE
+#define REPLACE
+#include <sys/types.h>
+
+struct GapBuffer;
+struct GapEdit;
+struct WorkPool;
+
+// Every match of a literal, or of a regular expression if `regex` is set,
+// found to be replaced with `with`. The text is cut at line breaks into
+// chunks that are searched on the worker pool. Matches are found the way
+// they are highlighted, except that an empty match right after another
+// match is skipped.
+struct Replace
+{
+    const char* pat;
+    ssize_t len;
+    int regex;
+    const char* with;
+    ssize_t with_len;
+    struct GapEdit* edits; // the matches found, in order
+    ssize_t count;
+};
+
+ssize_t
+Replace_find(struct Replace* rep, struct GapBuffer* gap, struct WorkPool* pool);
+
+void
+Replace_free(struct Replace* rep);
+#endif // !REPLACE
@@ -0,0 +1,187 @@
+#include "save.h"
+#include "gap.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// whether saving over the file in `st` has to write into it rather than
+// replace it with a new one: a new file would split off from its other hard
+// links, or might not get its owner and group back
+static int
+Save_keeps_file(const struct stat* st)
+{
+    return st->st_nlink > 1 || st->st_uid != geteuid() ||
+           st->st_gid != getegid();
+}
+
+// write the text over the file at `path`, for files that can't be replaced
+static int
+Save_in_place(struct GapBuffer* gap, const char* path, ssize_t* progress)
+{
+    if (gap->mapped) {
+        // writing over the file would show through untouched pages of the
+        // mapping; a snapshot can't move the text, see Save_start
+        if (gap->shared) {
+            errno = EBUSY;
+            return -1;
+        }
+        Gap_unmap(gap);
+    }
+    int fd = open(path, O_WRONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    if (Gap_write(gap, fd, progress) == -1 ||
+        ftruncate(fd, gap->size) == -1 || fsync(fd) == -1) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return close(fd);
+}
+
+// write the text to a temporary file next to `filename` and rename it into
+// place, so a failed save never leaves a truncated file behind. A symlink
+// is followed and kept, and a file that can't be replaced without losing
+// its hard links or owner is written over instead. Returns -1 with errno
+// set on failure.
+int
+Save_file(struct GapBuffer* gap, const char* filename, ssize_t* progress)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    int exists = 1;
+    if (!realpath(filename, path)) {
+        if (errno != ENOENT) {
+            return -1;
+        }
+        if (strlen(filename) >= PATH_MAX) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        strcpy(path, filename);
+        exists = 0;
+    } else if (stat(path, &st) == -1) {
+        return -1;
+    }
+    if (exists && st.st_nlink > 1) {
+        return Save_in_place(gap, path, progress);
+    }
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = mkstemp(tmp);
+    if (fd == -1) {
+        return -1;
+    }
+    if (exists && fchown(fd, st.st_uid, st.st_gid) == -1) {
+        close(fd);
+        unlink(tmp);
+        return Save_in_place(gap, path, progress);
+    }
+    mode_t mode = exists ? st.st_mode & 07777 : 0644;
+    if (fchmod(fd, mode) == -1 || Gap_write(gap, fd, progress) == -1 ||
+        fsync(fd) == -1) {
+        int err = errno;
+        close(fd);
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    if (close(fd) == -1 || rename(tmp, path) == -1) {
+        int err = errno;
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static void*
+Save_run(void* arg)
+{
+    struct SaveJob* job = arg;
+    int state = SAVE_DONE;
+    if (Save_file(job->snapshot, job->filename, &job->written) == -1) {
+        job->err = errno;
+        state = SAVE_FAILED;
+    }
+    __atomic_store_n(&job->state, state, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// save a snapshot of the text on a new thread, so editing can go on while
+// it is written. The snapshot shares the text, see Gap_snapshot, so
+// starting a save copies nothing. `dirty` is the number of edits the save
+// covers.
+void
+Save_start(struct SaveJob* job,
+           struct GapBuffer* gap,
+           const char* filename,
+           int dirty)
+{
+    if (!job->scratch) {
+        job->scratch = Bump_new(KILOBYTES(4), MEM_SCRATCH);
+    }
+    // a file that will be written over can't be read through a mapping
+    // meanwhile, the text moves to the heap first, see Save_in_place
+    struct stat st;
+    if (gap->mapped && stat(filename, &st) == 0 && Save_keeps_file(&st)) {
+        Gap_unmap(gap);
+    }
+    job->mark = Bump_mark(job->scratch);
+    job->snapshot = Gap_snapshot(gap, job->scratch);
+    job->filename = Bump_alloc_raw(job->scratch, strlen(filename) + 1);
+    strcpy(job->filename, filename);
+    job->dirty = dirty;
+    job->written = 0;
+    job->err = 0;
+    job->state = SAVE_RUNNING;
+    if (pthread_create(&job->thread, NULL, Save_run, job)) {
+        unix_error("pthread_create");
+    }
+}
+
+// reap the save thread and drop the snapshot, returning the final state
+static int
+Save_finish(struct SaveJob* job)
+{
+    pthread_join(job->thread, NULL);
+    int state = job->state;
+    job->state = SAVE_IDLE;
+    Gap_release(job->snapshot);
+    Bump_reset(job->scratch, job->mark);
+    job->snapshot = NULL;
+    job->filename = NULL;
+    return state;
+}
+
+// state of the job without blocking. A finished job is cleaned up and
+// reported once, after which the job is idle again.
+int
+Save_poll(struct SaveJob* job)
+{
+    int state = __atomic_load_n(&job->state, __ATOMIC_ACQUIRE);
+    if (state == SAVE_DONE || state == SAVE_FAILED) {
+        return Save_finish(job);
+    }
+    return state;
+}
+
+// block until a running save has finished
+int
+Save_wait(struct SaveJob* job)
+{
+    if (job->state == SAVE_IDLE) {
+        return SAVE_IDLE;
+    }
+    return Save_finish(job);
+}
@@ -0,0 +1,45 @@
+#ifndef SAVE_JOB
+#define SAVE_JOB
+#include "mem.h"
+#include <pthread.h>
+#include <sys/types.h>
+
+struct GapBuffer;
+
+enum SaveState
+{
+    SAVE_IDLE,
+    SAVE_RUNNING,
+    SAVE_DONE,
+    SAVE_FAILED
+};
+
+// a save running on its own thread against a snapshot of the text
+struct SaveJob
+{
+    pthread_t thread;
+    struct BumpAlloc* scratch; // holds the snapshot and filename
+    struct BumpMark mark;
+    struct GapBuffer* snapshot;
+    char* filename;
+    int dirty;       // edits covered by the snapshot
+    ssize_t written; // bytes written so far, updated by the save thread
+    int state;
+    int err;
+};
+
+int
+Save_file(struct GapBuffer* gap, const char* filename, ssize_t* progress);
+
+void
+Save_start(struct SaveJob* job,
+           struct GapBuffer* gap,
+           const char* filename,
+           int dirty);
+
+int
+Save_poll(struct SaveJob* job);
+
+int
+Save_wait(struct SaveJob* job);
+#endif // !SAVE_JOB
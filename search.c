@@ -0,0 +1,139 @@
+#include "search.h"
+#include "gap.h"
+#include <string.h>
+#include <sys/uio.h>
+
+void
+Search_init(struct Search* search, const char* pat, ssize_t len)
+{
+    if (len > SEARCH_MAX) {
+        len = SEARCH_MAX;
+    }
+    memmove(search->pat, pat, len);
+    search->len = len;
+    for (int c = 0; c < 256; c++) {
+        search->skip[c] = search->rskip[c] = len;
+    }
+    // the shift that lines the byte up with its nearest occurrence in the
+    // pattern, not counting the one at the edge of the window
+    for (ssize_t i = 0; i + 1 < len; i++) {
+        search->skip[(unsigned char)search->pat[i]] = len - 1 - i;
+    }
+    for (ssize_t i = len - 1; i > 0; i--) {
+        search->rskip[(unsigned char)search->pat[i]] = i;
+    }
+}
+
+// offset of the first match in `text`, or -1
+ssize_t
+Search_mem(const struct Search* search, const char* text, ssize_t len)
+{
+    const char* pat = search->pat;
+    ssize_t m = search->len;
+    ssize_t last = len - m;
+    ssize_t i = 0;
+    while (m && i <= last) {
+        const char* p = memchr(&text[i], pat[0], last - i + 1);
+        if (!p) {
+            break;
+        }
+        i = p - text;
+        unsigned char end = text[i + m - 1];
+        if (end == (unsigned char)pat[m - 1] && !memcmp(p, pat, m)) {
+            return i;
+        }
+        i += search->skip[end];
+    }
+    return -1;
+}
+
+// offset of the last match in `text`, or -1
+ssize_t
+Search_mem_last(const struct Search* search, const char* text, ssize_t len)
+{
+    const char* pat = search->pat;
+    ssize_t m = search->len;
+    ssize_t i = len - m;
+    while (m && i >= 0) {
+        if (text[i] == pat[0] && !memcmp(&text[i], pat, m)) {
+            return i;
+        }
+        i -= search->rskip[(unsigned char)text[i]];
+    }
+    return -1;
+}
+
+// whether the pattern matches at `at` in the two segments of `iov`
+static int
+match_across(const struct Search* search, const struct iovec* iov, ssize_t at)
+{
+    ssize_t a = iov[0].iov_len;
+    for (ssize_t k = 0; k < search->len; k++) {
+        ssize_t i = at + k;
+        char c = i < a ? ((char*)iov[0].iov_base)[i]
+                       : ((char*)iov[1].iov_base)[i - a];
+        if (c != search->pat[k]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Offset of the first match lying within [from, to), or -1. The text is
+// searched where it lies on either side of the gap, and only the few
+// places a match could straddle the gap are compared byte by byte.
+ssize_t
+Search_first(const struct Search* search,
+             struct GapBuffer* gap,
+             ssize_t from,
+             ssize_t to)
+{
+    struct iovec iov[2];
+    int n = Gap_iov(gap, from, to, iov);
+    if (!n) {
+        return -1;
+    }
+    ssize_t a = iov[0].iov_len;
+    ssize_t found = Search_mem(search, iov[0].iov_base, a);
+    if (found != -1 || n == 1) {
+        return found == -1 ? -1 : from + found;
+    }
+    ssize_t b = iov[1].iov_len;
+    ssize_t i = a - search->len + 1;
+    for (i = i < 0 ? 0 : i; i < a && i + search->len <= a + b; i++) {
+        if (match_across(search, iov, i)) {
+            return from + i;
+        }
+    }
+    found = Search_mem(search, iov[1].iov_base, b);
+    return found == -1 ? -1 : from + a + found;
+}
+
+// offset of the last match lying within [from, to), or -1
+ssize_t
+Search_last(const struct Search* search,
+            struct GapBuffer* gap,
+            ssize_t from,
+            ssize_t to)
+{
+    struct iovec iov[2];
+    int n = Gap_iov(gap, from, to, iov);
+    if (!n) {
+        return -1;
+    }
+    ssize_t a = iov[0].iov_len;
+    if (n == 2) {
+        ssize_t b = iov[1].iov_len;
+        ssize_t found = Search_mem_last(search, iov[1].iov_base, b);
+        if (found != -1) {
+            return from + a + found;
+        }
+        for (ssize_t i = a - 1; i >= 0 && i > a - search->len; i--) {
+            if (i + search->len <= a + b && match_across(search, iov, i)) {
+                return from + i;
+            }
+        }
+    }
+    ssize_t found = Search_mem_last(search, iov[0].iov_base, a);
+    return found == -1 ? -1 : from + found;
+}
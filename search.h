@@ -0,0 +1,41 @@
+#ifndef SEARCH
+#define SEARCH
+#include <sys/types.h>
+
+// longest pattern that can be searched for
+#define SEARCH_MAX (256)
+
+struct GapBuffer;
+
+// A substring matched with Horspool's algorithm: memchr finds the next
+// place the first byte occurs, and a mismatch skips ahead by as much as
+// the byte under the end of the window allows.
+struct Search
+{
+    char pat[SEARCH_MAX];
+    ssize_t len;
+    ssize_t skip[256];  // forward shift, by the last byte of the window
+    ssize_t rskip[256]; // backward shift, by the first byte of the window
+};
+
+void
+Search_init(struct Search* search, const char* pat, ssize_t len);
+
+ssize_t
+Search_mem(const struct Search* search, const char* text, ssize_t len);
+
+ssize_t
+Search_mem_last(const struct Search* search, const char* text, ssize_t len);
+
+ssize_t
+Search_first(const struct Search* search,
+             struct GapBuffer* gap,
+             ssize_t from,
+             ssize_t to);
+
+ssize_t
+Search_last(const struct Search* search,
+            struct GapBuffer* gap,
+            ssize_t from,
+            ssize_t to);
+#endif // !SEARCH
@@ -1,8 +1,26 @@
+#include "abuf.h"
+#include "batch.h"
+#include "frame.h"
 #include "gap.h"
+#include "hist.h"
+#include "mem.h"
+#include "re.h"
+#include "render.h"
+#include "replace.h"
+#include "save.h"
+#include "search.h"
+#include "texter.h"
+#include "undo.h"
+#include "util.h"
+#include "work.h"
 #include <check.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 START_TEST(init_empty_gapbuf)
 {
@@ -107,7 +125,7 @@ START_TEST(clamp_at_beginning)
     struct GapBuffer* gap = Gap_new("end");
     Gap_mov(gap, -20);
     Gap_insert_str(gap, "begin ");
-    char str[sizeof("bein end")];
+    char str[sizeof("begin end")];
     Gap_str(gap, str);
     ck_assert_str_eq("begin end", str);
 }
@@ -321,6 +339,852 @@ START_TEST(failing_case)
     ck_assert_str_eq("11", &gap->buf[gap->cur_end]);
 }
 
+START_TEST(growth_is_proportional_to_size)
+{
+    char text[4001];
+    memset(text, 'a', 4000);
+    text[4000] = '\0';
+    struct GapBuffer* gap = Gap_new(text);
+    Gap_mov(gap, 2000);
+    for (size_t i = 0; i < 64; i++) {
+        Gap_insert_chr(gap, 'b');
+    }
+    ck_assert(gap->capacity - gap->size >= 1000);
+    ck_assert(gap->capacity == gap->size + gap->cur_end - gap->cur_beg);
+    ck_assert(gap->buf[gap->capacity] == '\0');
+}
+END_TEST
+
+START_TEST(shrink_after_large_delete)
+{
+    char text[4001];
+    memset(text, 'a', 4000);
+    text[4000] = '\0';
+    struct GapBuffer* gap = Gap_new(text);
+    Gap_mov(gap, 10);
+    Gap_del(gap, 3980);
+    Gap_shrink(gap);
+    ck_assert(gap->capacity < 100);
+    char str[sizeof("aaaaaaaaaaaaaaaaaaaa")];
+    Gap_str(gap, str);
+    ck_assert_str_eq("aaaaaaaaaaaaaaaaaaaa", str);
+}
+END_TEST
+
+START_TEST(goto_line_clamps_column)
+{
+    struct GapBuffer* gap = Gap_new("first line\nsnd\nthird line");
+    Gap_goto_line(gap, 1, 8);
+    ck_assert_str_eq("\nthird line", &gap->buf[gap->cur_end]);
+    Gap_goto_line(gap, 5, 2);
+    ck_assert_str_eq("ird line", &gap->buf[gap->cur_end]);
+}
+END_TEST
+
+START_TEST(line_of_offset)
+{
+    struct GapBuffer* gap = Gap_new("ab\n\ncd\n");
+    ssize_t col;
+    ck_assert(Gap_lines(gap) == 4);
+    ck_assert(Gap_line_of(gap, 2, &col) == 0 && col == 2);
+    ck_assert(Gap_line_of(gap, 3, &col) == 1 && col == 0);
+    ck_assert(Gap_line_of(gap, 5, &col) == 2 && col == 1);
+    ck_assert(Gap_line_of(gap, 7, &col) == 3 && col == 0);
+}
+END_TEST
+
+START_TEST(line_index_follows_edits)
+{
+    // random edits, checking the index against a scan of the text
+    char text[2049];
+    for (size_t i = 0; i < 2048; i++) {
+        text[i] = i % 7 == 6 ? '\n' : 'x';
+    }
+    text[2048] = '\0';
+    struct GapBuffer* gap = Gap_new(text);
+    ck_assert(Gap_lines(gap) == 2048 / 7 + 1);
+    unsigned seed = 1;
+    char* str = malloc(64 * 1024);
+    for (int round = 0; round < 2000; round++) {
+        seed = seed * 1103515245 + 12345;
+        Gap_mov(gap, (seed >> 8) % (gap->size + 1) - gap->cur_beg);
+        switch ((seed >> 4) % 4) {
+            case 0:
+                Gap_insert_chr(gap, '\n');
+                break;
+            case 1:
+                Gap_insert_str(gap, "ins\nert\n\nmore");
+                break;
+            case 2:
+                Gap_del(gap, (seed >> 16) % 20);
+                break;
+            default:
+                Gap_insert_chr(gap, 'y');
+                break;
+        }
+        Gap_str(gap, str);
+        ssize_t line = 0;
+        ssize_t start = 0;
+        for (ssize_t i = 0; i <= gap->size; i++) {
+            if (i == gap->size || str[i] == '\n') {
+                ck_assert(Gap_line_start(gap, line) == start);
+                ck_assert(Gap_line_len(gap, line) == i - start);
+                start = i + 1;
+                line++;
+            }
+        }
+        ck_assert(Gap_lines(gap) == line);
+    }
+    free(str);
+    Gap_free(gap);
+}
+END_TEST
+
+START_TEST(mapped_file_is_not_modified)
+{
+    char path[] = "/tmp/texter-test-XXXXXX";
+    int fd = mkstemp(path);
+    ck_assert(fd != -1);
+    ck_assert(write(fd, "one\ntwo\nthree\n", 14) == 14);
+    struct GapBuffer* gap = Gap_map(fd, 14);
+    ck_assert(gap != NULL);
+    ck_assert(Gap_line_len(gap, 1) == 3);
+    Gap_goto_line(gap, 1, 3);
+    Gap_insert_str(gap, " and a half");
+    ck_assert(Gap_line_len(gap, 1) == 14);
+    ck_assert(Gap_lines(gap) == 4);
+    char str[sizeof("one\ntwo and a half\nthree\n")];
+    Gap_str(gap, str);
+    ck_assert_str_eq("one\ntwo and a half\nthree\n", str);
+    char file[15] = { 0 };
+    ck_assert(pread(fd, file, 14, 0) == 14);
+    ck_assert_str_eq("one\ntwo\nthree\n", file);
+    Gap_free(gap);
+    close(fd);
+    unlink(path);
+}
+END_TEST
+
+START_TEST(background_save_writes_snapshot)
+{
+    char path[] = "/tmp/texter-test-XXXXXX";
+    int fd = mkstemp(path);
+    ck_assert(fd != -1);
+    close(fd);
+    struct GapBuffer* gap = Gap_new("hello world");
+    Gap_mov(gap, 5);
+    struct SaveJob job = { .state = SAVE_IDLE };
+    Save_start(&job, gap, path, 1);
+    // edits after the snapshot is taken are not saved
+    Gap_insert_str(gap, ",");
+    ck_assert_int_eq(Save_wait(&job), SAVE_DONE);
+    ck_assert_int_eq(job.written, 11);
+    ck_assert_int_eq(Save_poll(&job), SAVE_IDLE);
+    char file[12] = { 0 };
+    fd = open(path, O_RDONLY);
+    ck_assert(read(fd, file, 11) == 11);
+    ck_assert_str_eq("hello world", file);
+    close(fd);
+    unlink(path);
+    Gap_free(gap);
+    Bump_free(job.scratch);
+}
+END_TEST
+
+START_TEST(snapshot_shares_text_until_overwritten)
+{
+    struct BumpAlloc* arena = Bump_new(KILOBYTES(4), MEM_SCRATCH);
+    struct GapBuffer* gap = Gap_new("hello world");
+    Gap_mov(gap, 5);
+    struct GapBuffer* snap = Gap_snapshot(gap, arena);
+    size_t copied;
+    size_t copies = Gap_unshared(&copied);
+    // typing into the gap and deleting leave the snapshot's text alone
+    Gap_insert_str(gap, ",");
+    Gap_del(gap, 1);
+    ck_assert_ptr_eq(gap->buf, snap->buf);
+    ck_assert_uint_eq(Gap_unshared(&copied), copies);
+    // moving forward fills the snapshot's gap, but moving back over what
+    // was deleted writes over its text, so the buffer moves to a copy
+    Gap_mov(gap, 3);
+    ck_assert_ptr_eq(gap->buf, snap->buf);
+    Gap_mov(gap, -3);
+    ck_assert(gap->buf != snap->buf);
+    ck_assert_uint_eq(Gap_unshared(&copied), copies + 1);
+    char out[16];
+    Gap_str(snap, out);
+    ck_assert_str_eq(out, "hello world");
+    Gap_str(gap, out);
+    ck_assert_str_eq(out, "hello,world");
+    Gap_release(snap);
+    // a snapshot let go of before any copy leaves the text with the buffer
+    snap = Gap_snapshot(gap, arena);
+    Gap_release(snap);
+    Gap_mov(gap, 3);
+    ck_assert_uint_eq(Gap_unshared(&copied), copies + 1);
+    Gap_free(gap);
+    Bump_free(arena);
+}
+END_TEST
+
+// the contents of a short Abuf, written through a pipe
+static char*
+abuf_str(struct Abuf* ab)
+{
+    static char out[256];
+    int fds[2];
+    ck_assert(pipe(fds) == 0);
+    ck_assert_int_eq(Abuf_write(ab, fds[1]), ab->len);
+    ssize_t n = read(fds[0], out, sizeof(out) - 1);
+    out[n > 0 ? n : 0] = '\0';
+    close(fds[0]);
+    close(fds[1]);
+    Abuf_reset(ab);
+    return out;
+}
+
+START_TEST(abuf_grows_across_chunks)
+{
+    struct Abuf* ab = Abuf_new();
+    size_t total = 3 * ABUF_CHUNK + 100;
+    char* text = malloc(total);
+    for (size_t i = 0; i < total; i++) {
+        text[i] = 'a' + i % 26;
+    }
+    for (int round = 0; round < 2; round++) {
+        for (size_t i = 0; i < total; i += 1000) {
+            Abuf_append(ab, &text[i], total - i < 1000 ? total - i : 1000);
+        }
+        ck_assert_uint_eq(ab->len, total);
+        char path[] = "/tmp/texter-test-XXXXXX";
+        int fd = mkstemp(path);
+        ck_assert_int_eq(Abuf_write(ab, fd), total);
+        char* back = malloc(total);
+        ck_assert_int_eq(pread(fd, back, total, 0), total);
+        ck_assert(!memcmp(text, back, total));
+        free(back);
+        close(fd);
+        unlink(path);
+        // chunks are reused by the next round
+        Abuf_reset(ab);
+    }
+    Abuf_free(ab);
+    free(text);
+}
+END_TEST
+
+START_TEST(hist_percentiles_within_bucket_precision)
+{
+    struct Hist h;
+    Hist_init(&h);
+    for (uint64_t us = 1; us <= 1000; us++) {
+        Hist_record(&h, us * 1000);
+    }
+    ck_assert_uint_eq(h.count, 1000);
+    ck_assert_uint_eq(h.min, 1000);
+    ck_assert_uint_eq(h.max, 1000000);
+    uint64_t p50 = Hist_percentile(&h, 50);
+    ck_assert(p50 > 500000 * 0.97 && p50 <= 501000);
+    uint64_t p99 = Hist_percentile(&h, 99);
+    ck_assert(p99 > 990000 * 0.97 && p99 <= 991000);
+    ck_assert_uint_eq(Hist_percentile(&h, 100), 1000000);
+    // small values are exact
+    Hist_init(&h);
+    Hist_record(&h, 7);
+    ck_assert_uint_eq(Hist_percentile(&h, 50), 7);
+}
+END_TEST
+
+START_TEST(frame_flush_emits_only_changes)
+{
+    struct Frame* frame = Frame_new(3, 10);
+    struct Abuf* ab = Abuf_new();
+    Frame_put(frame, 0, 0, "hello", 5, FRAME_PLAIN);
+    Frame_flush(frame, ab);
+    ck_assert_int_eq(ab->len, strlen("\x1b[1;1Hhello\x1b[K\x1b[2;1H\x1b[K"
+                                     "\x1b[3;1H\x1b[K"));
+    Abuf_reset(ab);
+    Frame_clear(frame);
+    Frame_put(frame, 0, 0, "hello", 5, FRAME_PLAIN);
+    Frame_flush(frame, ab);
+    ck_assert_int_eq(ab->len, 0);
+    Frame_clear(frame);
+    Frame_put(frame, 0, 0, "help", 4, FRAME_PLAIN);
+    Frame_flush(frame, ab);
+    ck_assert_str_eq(abuf_str(ab), "\x1b[1;4Hp\x1b[K");
+    Abuf_free(ab);
+    Frame_free(frame);
+}
+END_TEST
+
+START_TEST(frame_scroll_draws_exposed_rows)
+{
+    const char* rows[] = { "one", "two", "three", "four" };
+    struct Frame* frame = Frame_new(4, 10);
+    struct Abuf* ab = Abuf_new();
+    for (int i = 0; i < 3; i++) {
+        Frame_put(frame, i, 0, rows[i], strlen(rows[i]), FRAME_PLAIN);
+    }
+    Frame_put(frame, 3, 0, "status", 6, FRAME_INVERSE);
+    Frame_flush(frame, ab);
+    Abuf_reset(ab);
+    Frame_scroll(frame, ab, 0, 2, 1);
+    Frame_clear(frame);
+    for (int i = 0; i < 3; i++) {
+        Frame_put(frame, i, 0, rows[i + 1], strlen(rows[i + 1]), FRAME_PLAIN);
+    }
+    Frame_put(frame, 3, 0, "status", 6, FRAME_INVERSE);
+    Frame_flush(frame, ab);
+    ck_assert_str_eq(abuf_str(ab), "\x1b[1;3r\x1b[1S\x1b[r\x1b[3;1Hfour");
+    Abuf_free(ab);
+    Frame_free(frame);
+}
+END_TEST
+
+START_TEST(render_expands_tabs_to_tab_stops)
+{
+    struct GapBuffer* gap = Gap_new("a\tbc\td\nx");
+    struct RenderCache* cache = Render_new(4);
+    struct RenderLine* r = Render_line(cache, gap, 0, 80);
+    ck_assert_int_eq(r->len, 9);
+    ck_assert(!memcmp(r->text, "a   bc  d", 9));
+    ck_assert_int_eq(Render_rx(cache, gap, 0, 2), 4);
+    ck_assert_int_eq(Render_rx(cache, gap, 0, 5), 8);
+    // past the end of the line maps to the end
+    ck_assert_int_eq(Render_rx(cache, gap, 0, 20), 9);
+    Gap_mov(gap, 1);
+    Gap_del(gap, 1);
+    Render_edit(cache, 0, 0);
+    r = Render_line(cache, gap, 0, 80);
+    ck_assert_int_eq(r->len, 5);
+    ck_assert(!memcmp(r->text, "abc d", 5));
+    ck_assert_int_eq(Render_line(cache, gap, 1, 80)->len, 1);
+    Render_free(cache);
+    Gap_free(gap);
+}
+END_TEST
+
+START_TEST(bump_chains_blocks_and_resets_to_mark)
+{
+    struct BumpAlloc* arena = Bump_new(64, MEM_SCRATCH);
+    char* first = Bump_alloc(arena, 40);
+    memset(first, 'a', 40);
+    struct BumpMark mark = Bump_mark(arena);
+    // more than a block holds, and more than a block in one allocation
+    for (int i = 0; i < 10; i++) {
+        char* p = Bump_alloc_raw(arena, 48);
+        memset(p, 'b', 48);
+    }
+    char* big = Bump_alloc(arena, 1000);
+    ck_assert(big[0] == 0 && big[999] == 0);
+    ck_assert_uint_eq(arena->allocated, 40 + 10 * 48 + 1000);
+    Bump_reset(arena, mark);
+    ck_assert_uint_eq(arena->allocated, 40);
+    for (int i = 0; i < 40; i++) {
+        ck_assert(first[i] == 'a');
+    }
+    // the next allocation comes after the ones kept by the mark
+    char* again = Bump_alloc(arena, 16);
+    ck_assert(again >= first + 40 || again < first);
+    Bump_free(arena);
+}
+END_TEST
+
+START_TEST(pool_reuses_freed_blocks_and_grows)
+{
+    struct MemoryPool* pool = Pool_new(2, 24, MEM_OTHER);
+    void* a = Pool_alloc(pool);
+    void* b = Pool_alloc(pool);
+    // a full pool chains another slab rather than failing
+    void* c = Pool_alloc(pool);
+    ck_assert(a && b && c && a != b && b != c);
+    Pool_free(pool, b);
+    Pool_free(pool, a);
+    ck_assert_ptr_eq(Pool_alloc(pool), a);
+    ck_assert_ptr_eq(Pool_alloc(pool), b);
+    struct MemoryPool* other = Pool_new(2, 24, MEM_OTHER);
+    void* d = Pool_alloc(other);
+    Pool_free(other, Pool_alloc(other));
+    Pool_merge(pool, other);
+    Pool_free(pool, d);
+    ck_assert_ptr_eq(Pool_alloc(pool), d);
+    Pool_delete(pool);
+}
+END_TEST
+
+START_TEST(mem_tracks_live_and_peak_bytes)
+{
+    size_t live = Mem_live(MEM_TEXT);
+    size_t peak = Mem_peak(MEM_TEXT);
+    size_t allocs = Mem_allocs(MEM_TEXT);
+    char* text = malloc(KILOBYTES(64) + 1);
+    memset(text, 'x', KILOBYTES(64));
+    text[KILOBYTES(64)] = '\0';
+    struct GapBuffer* gap = Gap_new(text);
+    size_t grown = Mem_live(MEM_TEXT);
+    ck_assert(grown > live + KILOBYTES(64));
+    // the struct and the text
+    ck_assert_uint_eq(Mem_allocs(MEM_TEXT), allocs + 2);
+    Gap_free(gap);
+    // everything is given back, but the high-water mark stays
+    ck_assert_uint_eq(Mem_live(MEM_TEXT), live);
+    ck_assert(Mem_peak(MEM_TEXT) >= grown && Mem_peak(MEM_TEXT) >= peak);
+    free(text);
+}
+END_TEST
+
+START_TEST(undo_merges_typing_and_restores_deletes)
+{
+    struct GapBuffer* gap = Gap_new("hello");
+    struct UndoLog* log = Undo_new(KILOBYTES(64));
+    Undo_insert(log, 0, "a", 1);
+    Undo_insert(log, 1, "b", 1);
+    Undo_insert(log, 2, "c", 1);
+    // backspace twice over "lo", which continues as a run of deletes
+    Undo_delete(log, gap, 4, 1);
+    Undo_delete(log, gap, 3, 1);
+    struct UndoRecord* rec = Undo_undo(log);
+    ck_assert_int_eq(rec->kind, UNDO_DELETE);
+    ck_assert_int_eq(rec->at, 3);
+    ck_assert_int_eq(rec->len, 2);
+    ck_assert(!memcmp(rec->data, "lo", 2));
+    rec = Undo_undo(log);
+    ck_assert_int_eq(rec->kind, UNDO_INSERT);
+    ck_assert_int_eq(rec->len, 3);
+    ck_assert(!memcmp(rec->data, "abc", 3));
+    ck_assert_ptr_eq(Undo_undo(log), NULL);
+    ck_assert_int_eq(Undo_redo(log)->kind, UNDO_INSERT);
+    // a new edit drops what could have been redone
+    Undo_insert(log, 0, "xy", 2);
+    ck_assert_ptr_eq(Undo_redo(log), NULL);
+    Undo_free(log);
+    Gap_free(gap);
+}
+END_TEST
+
+START_TEST(undo_drops_oldest_edits_over_limit)
+{
+    char text[100];
+    memset(text, 'x', sizeof(text));
+    struct UndoLog* log = Undo_new(KILOBYTES(1));
+    for (int i = 0; i < 100; i++) {
+        Undo_insert(log, i * 100, text, sizeof(text));
+    }
+    ck_assert(log->cap <= KILOBYTES(1));
+    int undone = 0;
+    struct UndoRecord* rec;
+    while ((rec = Undo_undo(log))) {
+        ck_assert_int_eq(rec->at, (99 - undone) * 100);
+        undone++;
+    }
+    ck_assert(undone > 0 && undone < 10);
+    // an edit bigger than the limit cannot be undone, nor can those before it
+    char big[KILOBYTES(2)] = { 0 };
+    Undo_insert(log, 0, big, sizeof(big));
+    ck_assert_ptr_eq(Undo_undo(log), NULL);
+    Undo_free(log);
+}
+END_TEST
+
+START_TEST(search_finds_matches_across_the_gap)
+{
+    struct GapBuffer* gap = Gap_new("one needle, two needles, three");
+    struct Search search;
+    Search_init(&search, "needle", 6);
+    // put the gap inside both matches
+    Gap_mov(gap, 7 - gap->cur_beg);
+    ck_assert_int_eq(Search_first(&search, gap, 0, gap->size), 4);
+    ck_assert_int_eq(Search_first(&search, gap, 5, gap->size), 16);
+    ck_assert_int_eq(Search_last(&search, gap, 0, gap->size), 16);
+    ck_assert_int_eq(Search_last(&search, gap, 0, 21), 4);
+    Gap_mov(gap, 19 - gap->cur_beg);
+    ck_assert_int_eq(Search_first(&search, gap, 5, gap->size), 16);
+    ck_assert_int_eq(Search_last(&search, gap, 0, gap->size), 16);
+    ck_assert_int_eq(Search_first(&search, gap, 0, 9), -1);
+    Search_init(&search, "needless", 8);
+    ck_assert_int_eq(Search_first(&search, gap, 0, gap->size), -1);
+    Gap_free(gap);
+}
+END_TEST
+
+START_TEST(regex_finds_leftmost_longest_matches)
+{
+    struct GapBuffer* gap = Gap_new("ab12 cd345\nx99y\n\nend");
+    const char* err = NULL;
+    struct Regex* re = Re_compile("[a-z]+[0-9]+", 12, &err);
+    ck_assert_ptr_eq(err, NULL);
+    ssize_t end;
+    // put the gap inside the first two matches
+    Gap_mov(gap, 2 - gap->cur_beg);
+    ck_assert_int_eq(Re_first(re, gap, 0, gap->size, &end), 0);
+    ck_assert_int_eq(end, 4);
+    ck_assert_int_eq(Re_first(re, gap, 1, gap->size, &end), 1);
+    ck_assert_int_eq(Re_first(re, gap, 4, gap->size, &end), 5);
+    ck_assert_int_eq(end, 10);
+    ck_assert_int_eq(Re_last(re, gap, 0, gap->size, &end), 11);
+    ck_assert_int_eq(end, 14);
+    // only the text in the range is matched
+    ck_assert_int_eq(Re_first(re, gap, 0, 3, &end), 0);
+    ck_assert_int_eq(end, 3);
+    ck_assert_int_eq(Re_first(re, gap, 0, 2, &end), -1);
+    Re_free(re);
+    // anchors match at line boundaries, and matches do not span lines
+    re = Re_compile("^[a-z]*$", 8, &err);
+    ck_assert_int_eq(Re_first(re, gap, 0, gap->size, &end), 16);
+    ck_assert_int_eq(end, 16);
+    ck_assert_int_eq(Re_last(re, gap, 0, gap->size, &end), 17);
+    ck_assert_int_eq(end, 20);
+    Re_free(re);
+    re = Re_compile("5.x", 3, &err);
+    ck_assert_int_eq(Re_first(re, gap, 0, gap->size, &end), -1);
+    Re_free(re);
+    ck_assert_ptr_eq(Re_compile("(ab", 3, &err), NULL);
+    ck_assert_str_eq(err, "missing )");
+    ck_assert_ptr_eq(Re_compile("*a", 2, &err), NULL);
+    Gap_free(gap);
+    // a pattern that backtracks exponentially takes linear time here
+    size_t size = MEGABYTES(1);
+    char* text = malloc(size + 1);
+    memset(text, 'a', size);
+    text[size] = '\0';
+    gap = Gap_new(text);
+    re = Re_compile("(a*)*(a*)*b$", 12, &err);
+    ck_assert_int_eq(Re_first(re, gap, 0, gap->size, &end), -1);
+    Re_free(re);
+    Gap_free(gap);
+    free(text);
+}
+END_TEST
+
+START_TEST(replace_all_is_one_edit)
+{
+    // enough lines to be searched and copied in chunks on the pool
+    ssize_t lines = MEGABYTES(4) / 12;
+    char* text = malloc(12 * lines + 1);
+    char* want = malloc(14 * lines + 1);
+    for (ssize_t i = 0; i < lines; i++) {
+        memcpy(&text[12 * i], "foo bar foo\n", 12);
+        memcpy(&want[14 * i], "quux bar quux\n", 14);
+    }
+    text[12 * lines] = want[14 * lines] = '\0';
+    struct WorkPool* pool = Work_new(3);
+    Gap_set_workers(pool);
+    struct GapBuffer* gap = Gap_new(text);
+    Gap_mov(gap, 12 * (lines / 2) + 1);
+    struct Replace rep = {
+        .pat = "foo", .len = 3, .with = "quux", .with_len = 4
+    };
+    ck_assert_int_eq(Replace_find(&rep, gap, pool), 2 * lines);
+    struct UndoLog* log = Undo_new(UNDO_LIMIT);
+    ck_assert_int_eq(Undo_replace(log, gap, rep.edits, rep.count), 1);
+    Gap_splice(gap, rep.edits, rep.count);
+    Replace_free(&rep);
+    char* out = malloc(14 * lines + 1);
+    Gap_str(gap, out);
+    ck_assert(!strcmp(out, want));
+    ck_assert_int_eq(Gap_lines(gap), lines + 1);
+    // the whole replace comes back as one record
+    struct UndoRecord* rec = Undo_undo(log);
+    ck_assert_int_eq(rec->kind, UNDO_REPLACE);
+    struct GapEdit* edits = Undo_replace_edits(rec, 1);
+    Gap_splice(gap, edits, 2 * lines);
+    Mem_free(MEM_SCRATCH, edits, 2 * lines * sizeof(struct GapEdit));
+    Gap_str(gap, out);
+    ck_assert(!strcmp(out, text));
+    ck_assert_ptr_eq(Undo_undo(log), NULL);
+    edits = Undo_replace_edits(Undo_redo(log), 0);
+    Gap_splice(gap, edits, 2 * lines);
+    Mem_free(MEM_SCRATCH, edits, 2 * lines * sizeof(struct GapEdit));
+    Gap_str(gap, out);
+    ck_assert(!strcmp(out, want));
+    Gap_set_workers(NULL);
+    Work_free(pool);
+    Gap_free(gap);
+    // empty matches, except right after another match
+    gap = Gap_new("abxc\nx");
+    rep = (struct Replace){
+        .pat = "x*", .len = 2, .regex = 1, .with = "-", .with_len = 1
+    };
+    Replace_find(&rep, gap, NULL);
+    Gap_splice(gap, rep.edits, rep.count);
+    Replace_free(&rep);
+    Gap_str(gap, out);
+    ck_assert_str_eq(out, "-a-b-c-\n-");
+    Gap_free(gap);
+    Undo_free(log);
+    free(out);
+    free(want);
+    free(text);
+}
+END_TEST
+
+// an editor for batch scripts over `text`, in an arena of its own
+static struct EditorContext*
+new_batch_editor(char* text)
+{
+    struct BumpAlloc* bmp = Bump_new(KILOBYTES((size_t)64), MEM_OTHER);
+    struct EditorContext* ctx = Bump_alloc(bmp, sizeof(*ctx));
+    init_editor(ctx, NULL, bmp, 1);
+    ctx->gap = Gap_new(text);
+    return ctx;
+}
+
+static void
+free_batch_editor(struct EditorContext* ctx)
+{
+    struct BumpAlloc* bmp = ctx->bmp;
+    free_editor(ctx);
+    Bump_free(bmp);
+}
+
+// run `script` as a batch script, returning its exit status
+static int
+run_batch(struct EditorContext* ctx, const char* script)
+{
+    FILE* in = fmemopen((char*)script, strlen(script), "r");
+    int status = Batch_run(ctx, in, "script");
+    fclose(in);
+    return status;
+}
+
+START_TEST(batch_script_edits_without_a_terminal)
+{
+    struct EditorContext* ctx = new_batch_editor("one foo\ntwo foo\n");
+    const char* script = "# up, backspace and X as keys\n"
+                         "goto 2 5\n"
+                         "type new\\s\n"
+                         "keys \\e[A\\x7fX\n"
+                         "replace foo bar\n"
+                         "keys \\x06bar\\x07\n"
+                         "undo\n"
+                         "regex o+ 0\n";
+    ck_assert_int_eq(run_batch(ctx, script), EXIT_SUCCESS);
+    char out[64];
+    Gap_str(ctx->gap, out);
+    ck_assert_str_eq(out, "0ne f0X\ntw0 new f0\n");
+    ck_assert_int_eq(run_batch(ctx, "goto 1\nbogus\ntype x\n"), EXIT_FAILURE);
+    Gap_str(ctx->gap, out);
+    ck_assert_str_eq(out, "0ne f0X\ntw0 new f0\n");
+    free_batch_editor(ctx);
+}
+END_TEST
+
+START_TEST(batch_patterns_keep_regex_escapes)
+{
+    struct EditorContext* ctx = new_batch_editor("a1 b22\tc \\q\n");
+    // \d and \s reach the regex as classes, and \q stays as it is
+    const char* script = "regex \\d+ N\n"
+                         "regex \\s+ _\n"
+                         "replace \\q Q\\x21\n";
+    ck_assert_int_eq(run_batch(ctx, script), EXIT_SUCCESS);
+    char out[64];
+    Gap_str(ctx->gap, out);
+    ck_assert_str_eq(out, "aN_bN_c_Q!\n");
+    // text has no escapes but the listed ones
+    ck_assert_int_eq(run_batch(ctx, "type \\q\n"), EXIT_FAILURE);
+    free_batch_editor(ctx);
+}
+END_TEST
+
+START_TEST(backspace_run_is_one_undo)
+{
+    struct EditorContext* ctx = new_batch_editor("");
+    // an arrow key between the runs starts a new one
+    const char* script = "keys hello\n"
+                         "keys \\x7f\\x7f\\x7f\\e[D\\x7f\n"
+                         "undo\n";
+    ck_assert_int_eq(run_batch(ctx, script), EXIT_SUCCESS);
+    char out[64];
+    Gap_str(ctx->gap, out);
+    ck_assert_str_eq(out, "he");
+    ck_assert_int_eq(run_batch(ctx, "undo\n"), EXIT_SUCCESS);
+    Gap_str(ctx->gap, out);
+    ck_assert_str_eq(out, "hello");
+    free_batch_editor(ctx);
+}
+END_TEST
+
+START_TEST(parallel_index_matches_sequential)
+{
+    size_t size = MEGABYTES(5);
+    char* text = malloc(size + 1);
+    unsigned seed = 7;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        text[i] = (seed >> 16) % 50 ? 'x' : '\n';
+    }
+    text[size] = '\0';
+    struct GapBuffer* seq = Gap_new(text);
+    ssize_t lines = Gap_lines(seq);
+    struct WorkPool* pool = Work_new(3);
+    Gap_set_workers(pool);
+    struct GapBuffer* par = Gap_new(text);
+    Gap_mov(par, size / 3);
+    ck_assert(Gap_lines(par) == lines);
+    // fewer of the pool's threads split the work the same way
+    Work_set_threads(pool, 2);
+    struct GapBuffer* two = Gap_new(text);
+    ck_assert(Gap_lines(two) == lines);
+    Gap_set_workers(NULL);
+    Work_free(pool);
+    for (ssize_t line = 0; line < lines; line += 997) {
+        ck_assert(Gap_line_start(par, line) == Gap_line_start(seq, line));
+    }
+    ck_assert(Gap_line_start(par, lines - 1) ==
+              Gap_line_start(seq, lines - 1));
+    ck_assert(Gap_line_start(two, lines - 1) ==
+              Gap_line_start(seq, lines - 1));
+    Gap_free(seq);
+    Gap_free(par);
+    Gap_free(two);
+    free(text);
+}
+END_TEST
+
+START_TEST(regex_replace_on_one_long_line)
+{
+    // each match used to read the rest of the line backwards again, so this
+    // took minutes rather than milliseconds
+    ssize_t n = KILOBYTES(400) / 4;
+    char* text = malloc(4 * n + 1);
+    for (ssize_t i = 0; i < n; i++) {
+        memcpy(&text[4 * i], "abcd", 4);
+    }
+    text[4 * n] = '\0';
+    struct GapBuffer* gap = Gap_new(text);
+    // the first match to end is "c", but the leftmost starts at "a"
+    struct Replace rep = {
+        .pat = "abcd|c", .len = 6, .regex = 1, .with = "x", .with_len = 1
+    };
+    ck_assert_int_eq(Replace_find(&rep, gap, NULL), n);
+    ck_assert_int_eq(rep.edits[0].at, 0);
+    ck_assert_int_eq(rep.edits[0].len, 4);
+    ck_assert_int_eq(rep.edits[n - 1].at, 4 * (n - 1));
+    ck_assert_int_eq(rep.edits[n - 1].len, 4);
+    Replace_free(&rep);
+    Gap_free(gap);
+    free(text);
+}
+END_TEST
+
+START_TEST(regex_has_no_line_after_a_final_newline)
+{
+    struct GapBuffer* gap = Gap_new("a\nb\n");
+    struct Replace rep = {
+        .pat = "^", .len = 1, .regex = 1, .with = "// ", .with_len = 3
+    };
+    ck_assert_int_eq(Replace_find(&rep, gap, NULL), 2);
+    Gap_splice(gap, rep.edits, rep.count);
+    Replace_free(&rep);
+    char out[16];
+    Gap_str(gap, out);
+    ck_assert_str_eq(out, "// a\n// b\n");
+    Gap_free(gap);
+    gap = Gap_new("a\nb\n");
+    const char* err;
+    struct Regex* re = Re_compile("$", 1, &err);
+    ssize_t end;
+    ck_assert_int_eq(Re_first(re, gap, 0, gap->size, &end), 1);
+    ck_assert_int_eq(Re_first(re, gap, 2, gap->size, &end), 3);
+    ck_assert_int_eq(Re_first(re, gap, 4, gap->size, &end), -1);
+    ck_assert_int_eq(Re_last(re, gap, 0, gap->size, &end), 3);
+    Re_free(re);
+    Gap_free(gap);
+}
+END_TEST
+
+START_TEST(far_moves_in_a_mapping_remap_pages)
+{
+    char path[] = "/tmp/texter-test-XXXXXX";
+    int fd = mkstemp(path);
+    ck_assert(fd != -1);
+    // longer than the gap, so the pages are moved in several steps
+    ssize_t size = MEGABYTES(4) + 123;
+    char* text = malloc(size + 2);
+    unsigned seed = 1;
+    for (ssize_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        text[i] = 'a' + (seed >> 8) % 26;
+    }
+    text[size] = '\0';
+    ck_assert(write(fd, text, size) == size);
+    struct GapBuffer* gap = Gap_map(fd, size);
+    ck_assert(gap != NULL);
+    char* out = malloc(size + 2);
+    Gap_mov(gap, MEGABYTES(3) + 77);
+    Gap_str(gap, out);
+    ck_assert(!memcmp(out, text, size + 1));
+    Gap_mov(gap, -MEGABYTES(2) - 5);
+    Gap_str(gap, out);
+    ck_assert(!memcmp(out, text, size + 1));
+    ck_assert(gap->mapped);
+    Gap_insert_chr(gap, '!');
+    memmove(&text[MEGABYTES(1) + 73],
+            &text[MEGABYTES(1) + 72],
+            size - MEGABYTES(1) - 72 + 1);
+    text[MEGABYTES(1) + 72] = '!';
+    Gap_str(gap, out);
+    ck_assert(!memcmp(out, text, size + 2));
+    Gap_free(gap);
+    char head[4];
+    ck_assert(pread(fd, head, 4, MEGABYTES(1) + 72) == 4);
+    ck_assert(!memcmp(head, &text[MEGABYTES(1) + 73], 4));
+    free(out);
+    free(text);
+    close(fd);
+    unlink(path);
+}
+END_TEST
+
+START_TEST(save_keeps_symlinks_and_hard_links)
+{
+    char dir[] = "/tmp/texter-test-XXXXXX";
+    ck_assert_ptr_eq(mkdtemp(dir), dir);
+    char file[64], link_path[64], other[64];
+    snprintf(file, sizeof(file), "%s/file", dir);
+    snprintf(link_path, sizeof(link_path), "%s/link", dir);
+    snprintf(other, sizeof(other), "%s/other", dir);
+    int fd = open(file, O_WRONLY | O_CREAT, 0600);
+    ck_assert(write(fd, "old\n", 4) == 4);
+    close(fd);
+    ck_assert_int_eq(symlink("file", link_path), 0);
+    // saving through the link writes the file it points to
+    struct GapBuffer* gap = Gap_new("new\n");
+    ck_assert_int_eq(Save_file(gap, link_path, NULL), 0);
+    Gap_free(gap);
+    struct stat st;
+    ck_assert_int_eq(lstat(link_path, &st), 0);
+    ck_assert(S_ISLNK(st.st_mode));
+    char text[8] = { 0 };
+    fd = open(file, O_RDONLY);
+    ck_assert(read(fd, text, sizeof(text)) == 4);
+    close(fd);
+    ck_assert_str_eq(text, "new\n");
+    // a file with another hard link is written over, even while mapped
+    ck_assert_int_eq(link(file, other), 0);
+    fd = open(file, O_RDONLY);
+    gap = Gap_map(fd, 4);
+    close(fd);
+    Gap_insert_chr(gap, '>');
+    struct SaveJob job = { .state = SAVE_IDLE };
+    Save_start(&job, gap, file, 1);
+    ck_assert_int_eq(Save_wait(&job), SAVE_DONE);
+    memset(text, 0, sizeof(text));
+    fd = open(other, O_RDONLY);
+    ck_assert(read(fd, text, sizeof(text)) == 5);
+    close(fd);
+    ck_assert_str_eq(text, ">new\n");
+    Gap_str(gap, text);
+    ck_assert_str_eq(text, ">new\n");
+    Gap_free(gap);
+    Bump_free(job.scratch);
+    unlink(other);
+    unlink(link_path);
+    unlink(file);
+    ck_assert_int_eq(rmdir(dir), 0);
+}
+END_TEST
+
 Suite*
 test_suite(void)
 {
@@ -357,6 +1221,35 @@ test_suite(void)
     tcase_add_test(tc_core, delete_newline);
     tcase_add_test(tc_core, delete_then_mov);
     tcase_add_test(tc_core, failing_case);
+    tcase_add_test(tc_core, growth_is_proportional_to_size);
+    tcase_add_test(tc_core, shrink_after_large_delete);
+    tcase_add_test(tc_core, goto_line_clamps_column);
+    tcase_add_test(tc_core, line_of_offset);
+    tcase_add_test(tc_core, line_index_follows_edits);
+    tcase_add_test(tc_core, mapped_file_is_not_modified);
+    tcase_add_test(tc_core, parallel_index_matches_sequential);
+    tcase_add_test(tc_core, bump_chains_blocks_and_resets_to_mark);
+    tcase_add_test(tc_core, pool_reuses_freed_blocks_and_grows);
+    tcase_add_test(tc_core, background_save_writes_snapshot);
+    tcase_add_test(tc_core, abuf_grows_across_chunks);
+    tcase_add_test(tc_core, hist_percentiles_within_bucket_precision);
+    tcase_add_test(tc_core, frame_flush_emits_only_changes);
+    tcase_add_test(tc_core, frame_scroll_draws_exposed_rows);
+    tcase_add_test(tc_core, render_expands_tabs_to_tab_stops);
+    tcase_add_test(tc_core, mem_tracks_live_and_peak_bytes);
+    tcase_add_test(tc_core, undo_merges_typing_and_restores_deletes);
+    tcase_add_test(tc_core, undo_drops_oldest_edits_over_limit);
+    tcase_add_test(tc_core, search_finds_matches_across_the_gap);
+    tcase_add_test(tc_core, regex_finds_leftmost_longest_matches);
+    tcase_add_test(tc_core, replace_all_is_one_edit);
+    tcase_add_test(tc_core, batch_script_edits_without_a_terminal);
+    tcase_add_test(tc_core, backspace_run_is_one_undo);
+    tcase_add_test(tc_core, snapshot_shares_text_until_overwritten);
+    tcase_add_test(tc_core, batch_patterns_keep_regex_escapes);
+    tcase_add_test(tc_core, regex_replace_on_one_long_line);
+    tcase_add_test(tc_core, regex_has_no_line_after_a_final_newline);
+    tcase_add_test(tc_core, far_moves_in_a_mapping_remap_pages);
+    tcase_add_test(tc_core, save_keeps_symlinks_and_hard_links);
 
     suite_add_tcase(s, tc_core);
     return s;
@@ -1,18 +1,30 @@
 #include "texter.h"
 #include "abuf.h"
+#include "event.h"
+#include "frame.h"
 #include "gap.h"
 #include "mem.h"
+#include "re.h"
+#include "render.h"
+#include "replace.h"
+#include "save.h"
+#include "search.h"
+#include "undo.h"
 #include "util.h"
+#include "work.h"
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
@@ -20,14 +32,12 @@
 #define TEXTER_VERSION "0.0.1"
 
 #define CTRL_KEY(k) ((k) & 0x1f)
-#define CLEAR_SCREEN ("\x1b[2J")
-#define RESET_CURSOR ("\x1b[H")
-#define BLINK_CURSOR ("\x1b[?25h")
-#define ERASE_LINE ("\x1b[K")
-#define TABWIDTH (4)
+#define SHOW_CURSOR ("\x1b[?25h")
+// seconds a status message stays up
+#define STATUS_SECS (5)
 
 char*
-prompt(struct EditorContext* ctx, char* prompt);
+prompt(struct EditorContext* ctx, char* prompt, int empty_ok);
 
 int
 window_size(ssize_t* rows, ssize_t* cols)
@@ -51,59 +61,148 @@ window_size(ssize_t* rows, ssize_t* cols)
     }
 }
 
+ssize_t
+cursor_offset(struct EditorContext* ctx)
+{
+    return Gap_line_start(ctx->gap, ctx->cy) + ctx->cx;
+}
+
 void
-del_row(struct EditorContext* ctx, unsigned at)
+cursor_set(struct EditorContext* ctx, ssize_t offset)
 {
-    if (at >= ctx->n_rows) {
-        return;
-    }
-    free(ctx->lines[at]);
-    memmove(&ctx->lines[at],
-            &ctx->lines[at + 1],
-            sizeof(*ctx->lines) * (ctx->n_rows - at - 1));
-    ctx->n_rows--;
+    ctx->cy = Gap_line_of(ctx->gap, offset, &ctx->cx);
+}
+
+// every change to the text goes through apply_insert and apply_delete.
+// The gap only follows the cursor when the text is about to change, and
+// only the rendered lines the change touches are dropped.
+void
+apply_insert(struct EditorContext* ctx, ssize_t at, const char* s, ssize_t len)
+{
+    ssize_t col;
+    ssize_t line = Gap_line_of(ctx->gap, at, &col);
+    Gap_mov(ctx->gap, at - ctx->gap->cur_beg);
+    Gap_insert(ctx->gap, s, len);
+    cursor_set(ctx, at + len);
+    Render_edit(ctx->render, line, ctx->cy - line);
     ctx->dirty++;
 }
 
 void
-insert_row(struct EditorContext* ctx, unsigned at, char* s)
+apply_delete(struct EditorContext* ctx, ssize_t at, ssize_t len)
 {
-    if (at > ctx->n_rows) {
-        return;
-    }
-    ctx->lines = Realloc(ctx->lines, sizeof(*ctx->lines) * (ctx->n_rows + 1));
-    memmove(&ctx->lines[at + 1],
-            &ctx->lines[at],
-            sizeof(*ctx->lines) * (ctx->n_rows - at));
-    ctx->lines[at] = Gap_new(s);
+    ssize_t col;
+    ssize_t line = Gap_line_of(ctx->gap, at, &col);
+    ssize_t end = Gap_line_of(ctx->gap, at + len, &col);
+    Gap_mov(ctx->gap, at - ctx->gap->cur_beg);
+    Gap_del(ctx->gap, len);
+    cursor_set(ctx, at);
+    Render_edit(ctx->render, line, line - end);
+    ctx->dirty++;
+    // the gap may need shrinking
+    ctx->idle_pending = 1;
+}
+
+// edits made by the user, which can be undone
+void
+text_insert(struct EditorContext* ctx, ssize_t at, const char* s, ssize_t len)
+{
+    Undo_insert(ctx->undo, at, s, len);
+    apply_insert(ctx, at, s, len);
+}
+
+void
+text_delete(struct EditorContext* ctx, ssize_t at, ssize_t len)
+{
+    Undo_delete(ctx->undo, ctx->gap, at, len);
+    apply_delete(ctx, at, len);
+}
 
-    ctx->n_rows++;
+// many edits at once, in one pass over the text. Every line may have
+// moved, so all of them are rendered again.
+void
+apply_splice(struct EditorContext* ctx, const struct GapEdit* edits, ssize_t n)
+{
+    Gap_splice(ctx->gap, edits, n);
+    cursor_set(ctx, edits[0].at);
+    Render_edit(ctx->render, 0, 1);
     ctx->dirty++;
+    ctx->idle_pending = 1;
 }
 
-int
-row_cx_to_rx(struct GapBuffer* row, struct BumpAlloc scratch, int cx)
-{
-    int rx = 0;
-    char* buf = Bump_alloc(&scratch, cx + 1);
-    Gap_substr(row, 0, cx, buf);
-    for (int i = 0; i < cx; i++) {
-        if (buf[i] == '\t') {
-            rx += TABWIDTH - (rx % TABWIDTH);
-        } else {
-            rx++;
-        }
+// a replace, or its undo, made again from its record
+static void
+apply_replace(struct EditorContext* ctx, struct UndoRecord* rec, int revert)
+{
+    struct UndoReplace* rep = (struct UndoReplace*)rec->data;
+    struct GapEdit* edits = Undo_replace_edits(rec, revert);
+    apply_splice(ctx, edits, rep->count);
+    Mem_free(MEM_SCRATCH, edits, rep->count * sizeof(struct GapEdit));
+}
+
+// revert the last edit, leaving the cursor where it was made
+void
+undo(struct EditorContext* ctx)
+{
+    struct UndoRecord* rec = Undo_undo(ctx->undo);
+    if (!rec) {
+        set_status(ctx, "nothing to undo");
+    } else if (rec->kind == UNDO_REPLACE) {
+        apply_replace(ctx, rec, 1);
+    } else if (rec->kind == UNDO_INSERT) {
+        apply_delete(ctx, rec->at, rec->len);
+    } else {
+        apply_insert(ctx, rec->at, rec->data, rec->len);
     }
-    return rx;
 }
 
 void
-editor_scroll(struct EditorContext* ctx)
+redo(struct EditorContext* ctx)
 {
-    ctx->rx = 0;
-    if (ctx->cy < ctx->n_rows) {
-        ctx->rx = row_cx_to_rx(ctx->lines[ctx->cy], *ctx->bmp, ctx->cx);
+    struct UndoRecord* rec = Undo_redo(ctx->undo);
+    if (!rec) {
+        set_status(ctx, "nothing to redo");
+    } else if (rec->kind == UNDO_REPLACE) {
+        apply_replace(ctx, rec, 0);
+    } else if (rec->kind == UNDO_INSERT) {
+        apply_insert(ctx, rec->at, rec->data, rec->len);
+    } else {
+        apply_delete(ctx, rec->at, rec->len);
+    }
+}
+
+// replace every match of a pattern with `with`, as one edit that can be
+// undone
+void
+replace_all(struct EditorContext* ctx,
+            const char* pat,
+            ssize_t len,
+            int regex,
+            const char* with)
+{
+    struct Replace rep = {
+        .pat = pat, .len = len, .regex = regex, .with = with,
+        .with_len = strlen(with),
+    };
+    ssize_t n = Replace_find(&rep, ctx->gap, ctx->workers);
+    if (!n) {
+        set_status(ctx, "nothing to replace");
+        return;
     }
+    int kept = Undo_replace(ctx->undo, ctx->gap, rep.edits, n);
+    apply_splice(ctx, rep.edits, n);
+    Replace_free(&rep);
+    set_status(ctx,
+               "replaced %zd match%s%s",
+               n,
+               n == 1 ? "" : "es",
+               kept ? "" : " (too big to undo)");
+}
+
+void
+editor_scroll(struct EditorContext* ctx)
+{
+    ctx->rx = Render_rx(ctx->render, ctx->gap, ctx->cy, ctx->cx);
     if (ctx->cy < ctx->row_offset) {
         ctx->row_offset = ctx->cy;
     } else if (ctx->cy >= ctx->row_offset + ctx->screenrows) {
@@ -112,73 +211,127 @@ editor_scroll(struct EditorContext* ctx)
     if (ctx->rx < ctx->col_offset) {
         ctx->col_offset = ctx->rx;
     } else if (ctx->rx >= ctx->col_offset + ctx->screencols) {
-        ctx->col_offset = ctx->rx + ctx->screencols + 1;
+        ctx->col_offset = ctx->rx - ctx->screencols + 1;
+    }
+}
+
+// the first match of the search in progress within [from, to), or -1.
+// Its end goes in *end.
+ssize_t
+match_first(struct EditorContext* ctx, ssize_t from, ssize_t to, ssize_t* end)
+{
+    if (ctx->regex) {
+        return Re_first(ctx->regex, ctx->gap, from, to, end);
+    }
+    ssize_t m = Search_first(ctx->search, ctx->gap, from, to);
+    *end = m + ctx->search->len;
+    return m;
+}
+
+// the last match starting before `before`, or -1
+ssize_t
+match_before(struct EditorContext* ctx, ssize_t before, ssize_t* end)
+{
+    if (ctx->regex) {
+        return Re_last(ctx->regex, ctx->gap, 0, before, end);
+    }
+    ssize_t len = ctx->search->len;
+    ssize_t m = Search_last(ctx->search, ctx->gap, 0, before + len - 1);
+    *end = m + len;
+    return m;
+}
+
+// the last byte of a rendered line drawn at or before column rx
+static ssize_t
+byte_at_rx(struct RenderLine* r, ssize_t rx)
+{
+    ssize_t lo = 0, hi = r->bytes;
+    while (lo < hi) {
+        ssize_t mid = lo + (hi - lo + 1) / 2;
+        if (r->rx[mid] <= rx) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+// highlight the matches on a drawn line, the current one in inverse. The
+// search starts where the view does, rather than walking every match left
+// of it. A literal match running into the view is still found from one
+// pattern length back; a regex is matched from the view's left edge on.
+void
+draw_matches(struct EditorContext* ctx,
+             struct Frame* frame,
+             ssize_t y,
+             ssize_t line,
+             struct RenderLine* r)
+{
+    ssize_t start = Gap_line_start(ctx->gap, line);
+    ssize_t rendered = start + r->bytes;
+    ssize_t m = start + byte_at_rx(r, ctx->col_offset);
+    if (!ctx->regex) {
+        m -= ctx->search->len - 1;
+        m = m < start ? start : m;
+    }
+    ssize_t end;
+    while ((m = match_first(ctx, m, rendered, &end)) != -1) {
+        ssize_t from = r->rx[m - start];
+        ssize_t to = r->rx[end - start];
+        if (from >= ctx->col_offset + ctx->screencols) {
+            break;
+        }
+        if (to > ctx->col_offset) {
+            from = from < ctx->col_offset ? ctx->col_offset : from;
+            Frame_put(frame,
+                      y,
+                      from - ctx->col_offset,
+                      &r->text[from],
+                      to - from,
+                      m == ctx->match ? FRAME_INVERSE : FRAME_MATCH);
+        }
+        // step past empty matches
+        m = end > m ? end : m + 1;
     }
 }
 
 void
-draw_rows(struct EditorContext* ctx, struct Abuf* ab)
+draw_rows(struct EditorContext* ctx, struct Frame* frame)
 {
+    struct GapBuffer* gap = ctx->gap;
+    ssize_t n_rows = Gap_index_lines(gap, ctx->row_offset + ctx->screenrows);
     for (unsigned y = 0; y < ctx->screenrows; y++) {
         unsigned filerow = y + ctx->row_offset;
-        if (filerow >= ctx->n_rows) {
-            if (ctx->n_rows == 0 && y == (ctx->screenrows / 3)) {
+        if (filerow >= n_rows) {
+            Frame_put(frame, y, 0, "~", 1, FRAME_PLAIN);
+            if (gap->size == 0 && y == (ctx->screenrows / 3)) {
                 const char welcome[] =
                   "Tutorial text-editor -- version " TEXTER_VERSION;
-                size_t welcome_len = sizeof(welcome);
-                int padding = (ctx->screencols - welcome_len) / 2;
-                if (padding) {
-                    Abuf_append(ab, "~", 1);
-                    padding--;
-                }
-                while (padding) {
-                    Abuf_append(ab, " ", 1);
-                    padding--;
-                }
-                Abuf_append(ab, welcome, welcome_len);
-            } else {
-                Abuf_append(ab, "~", 1);
+                ssize_t welcome_len = sizeof(welcome) - 1;
+                ssize_t padding = (ctx->screencols - welcome_len) / 2;
+                Frame_put(frame,
+                          y,
+                          padding > 0 ? padding : 0,
+                          welcome,
+                          welcome_len,
+                          FRAME_PLAIN);
             }
         } else {
-            struct BumpAlloc bmp = *ctx->bmp;
-            struct GapBuffer* gap = ctx->lines[filerow];
-            unsigned len = gap->size - ctx->col_offset;
-            if (gap->size < ctx->col_offset) {
-                len = 0;
-            } else {
-                len = gap->size - ctx->col_offset;
-            }
-            if (len > ctx->screencols) {
-                len = ctx->screencols;
-            }
-            char* to_render = Bump_alloc(&bmp, ctx->screencols + 1);
-            Gap_substr(gap,
-                       ctx->col_offset,
-                       ctx->col_offset + ctx->screencols,
-                       to_render);
-            int tabs = 0;
-            for (size_t i = 0; to_render[i]; i++) {
-                if (to_render[i] == '\t') {
-                    tabs++;
-                }
+            struct RenderLine* r = Render_line(
+              ctx->render, gap, filerow, ctx->col_offset + ctx->screencols);
+            if (r->len > ctx->col_offset) {
+                Frame_put(frame,
+                          y,
+                          0,
+                          &r->text[ctx->col_offset],
+                          r->len - ctx->col_offset,
+                          FRAME_PLAIN);
             }
-            int tab_chars = tabs * (TABWIDTH - 1);
-            // a render string only needs to live as long as a single interation
-            char* render = Bump_alloc(&bmp, strlen(to_render) + tab_chars + 1);
-            int i = 0;
-            for (int j = 0; to_render[j]; j++) {
-                if (to_render[j] == '\t') {
-                    i +=
-                      snprintf(render + i, TABWIDTH + 1, "%*c", TABWIDTH, ' ');
-                } else {
-                    render[i] = to_render[j];
-                    i++;
-                }
+            if (ctx->search->len || ctx->regex) {
+                draw_matches(ctx, frame, y, filerow, r);
             }
-            Abuf_append(ab, render, i);
         }
-        Abuf_append(ab, ERASE_LINE, sizeof(ERASE_LINE));
-        Abuf_append(ab, "\r\n", 2);
     }
 }
 
@@ -195,44 +348,107 @@ place_cursor(struct EditorContext* ctx, struct Abuf* ab)
 }
 
 void
-draw_status_bar(struct EditorContext* ctx, struct Abuf* ab)
+draw_status_bar(struct EditorContext* ctx, struct Frame* frame)
 {
-    Abuf_append(ab, "\x1b[7m", 4);
+    ssize_t row = ctx->screenrows;
     char status[80], rstatus[80];
     char* filename = ctx->filename ? ctx->filename : "[No Name]";
+    // the line count is a lower bound until the whole file is indexed
+    ssize_t n_rows = Gap_index_lines(ctx->gap, 0);
+    char* more = Gap_index_done(ctx->gap) ? "" : "+";
     unsigned len = snprintf(status,
                             sizeof(status),
-                            "%.20s - %zd lines %s",
+                            "%.20s - %zd%s lines %s",
                             filename,
-                            ctx->n_rows,
+                            n_rows,
+                            more,
                             ctx->dirty ? "(modified)" : "");
-    unsigned rlen =
-      snprintf(rstatus, sizeof(rstatus), "%zd/%zd", ctx->cy + 1, ctx->n_rows);
-    if (len > ctx->screencols) {
-        len = ctx->screencols;
-    }
-    Abuf_append(ab, status, len);
-    for (; len < ctx->screencols; len++) {
-        if (ctx->screencols - len == rlen) {
-            Abuf_append(ab, rstatus, rlen);
+    unsigned rlen = snprintf(
+      rstatus, sizeof(rstatus), "%zd/%zd%s", ctx->cy + 1, n_rows, more);
+    Frame_fill(frame, row, 0, ' ', FRAME_INVERSE);
+    Frame_put(frame, row, 0, status, len, FRAME_INVERSE);
+    if (len + rlen <= ctx->screencols) {
+        Frame_put(frame,
+                  row,
+                  ctx->screencols - rlen,
+                  rstatus,
+                  rlen,
+                  FRAME_INVERSE);
+    }
+}
+
+// a summary of the latency histograms
+void
+draw_latency(struct EditorContext* ctx, struct Frame* frame)
+{
+    struct Latency* lat = ctx->latency;
+    char msg[128];
+    int len = snprintf(
+      msg,
+      sizeof(msg),
+      "key to paint p50 %.2fms p99 %.2fms max %.2fms | render p99 %.2fms | "
+      "%lu bytes/frame",
+      Hist_percentile(&lat->total, 50) / 1e6,
+      Hist_percentile(&lat->total, 99) / 1e6,
+      lat->total.max / 1e6,
+      Hist_percentile(&lat->render, 99) / 1e6,
+      (unsigned long)(lat->bytes.count ? lat->bytes.sum / lat->bytes.count
+                                       : 0));
+    Frame_put(frame, ctx->screenrows + 1, 0, msg, len, FRAME_PLAIN);
+}
+
+// a byte count in the largest unit that keeps it at one digit or more
+static void
+format_bytes(char* out, size_t size, size_t bytes)
+{
+    const char* units = "BKMG";
+    double n = bytes;
+    while (n >= 1024 && units[1]) {
+        n /= 1024;
+        units++;
+    }
+    snprintf(out, size, "%.*f%c", *units == 'B' ? 0 : 1, n, *units);
+}
+
+// live and peak bytes of each kind of memory in use
+void
+draw_memory(struct EditorContext* ctx, struct Frame* frame)
+{
+    char msg[256];
+    int len = 0;
+    for (int tag = 0; tag < MEM_TAGS; tag++) {
+        if (!Mem_peak(tag)) {
+            continue;
+        }
+        char live[16], peak[16];
+        format_bytes(live, sizeof(live), Mem_live(tag));
+        format_bytes(peak, sizeof(peak), Mem_peak(tag));
+        len += snprintf(&msg[len],
+                        sizeof(msg) - len,
+                        "%s%s %s/%s",
+                        len ? " | " : "",
+                        Mem_name(tag),
+                        live,
+                        peak);
+        if (len >= (int)sizeof(msg)) {
+            len = sizeof(msg) - 1;
             break;
         }
-        Abuf_append(ab, " ", 1);
     }
-    Abuf_append(ab, "\x1b[m", 3);
-    Abuf_append(ab, "\r\n", 2);
+    Frame_put(frame, ctx->screenrows + 1, 0, msg, len, FRAME_PLAIN);
 }
 
 void
-draw_status_msg(struct EditorContext* ctx, struct Abuf* ab)
+draw_status_msg(struct EditorContext* ctx, struct Frame* frame)
 {
-    Abuf_append(ab, "\x1b[K", 3);
     unsigned msglen = strlen(ctx->status_msg);
-    if (msglen > ctx->screencols) {
-        msglen = ctx->screencols;
-    }
-    if (msglen && time(NULL) - ctx->status_time < 5) {
-        Abuf_append(ab, ctx->status_msg, msglen);
+    if (msglen && Event_now() - ctx->status_time < STATUS_SECS) {
+        Frame_put(frame,
+                  ctx->screenrows + 1,
+                  0,
+                  ctx->status_msg,
+                  msglen,
+                  FRAME_PLAIN);
     }
 }
 
@@ -243,113 +459,246 @@ set_status(struct EditorContext* ctx, const char* fmt, ...)
     va_start(ap, fmt);
     vsnprintf(ctx->status_msg, sizeof(ctx->status_msg), fmt, ap);
     va_end(ap);
-    ctx->status_time = time(NULL);
+    ctx->status_time = Event_now();
+    // redraw when the message expires
+    if (ctx->events) {
+        Event_timer_at(ctx->events, ctx->status_time + STATUS_SECS);
+    }
 }
 
 void
 refresh_ui(struct EditorContext* ctx)
 {
+    if (ctx->batch) {
+        return;
+    }
     struct Abuf* ab = ctx->ab;
+    struct Frame* frame = ctx->frame;
+    struct Latency* lat = ctx->latency;
+    uint64_t start = Hist_now();
     editor_scroll(ctx);
-    Abuf_append(ab, RESET_CURSOR, sizeof(RESET_CURSOR));
-    draw_rows(ctx, ab);
-    draw_status_bar(ctx, ab);
-    draw_status_msg(ctx, ab);
+    // let the terminal move rows that are still on screen after scrolling
+    Frame_scroll(
+      frame, ab, 0, ctx->screenrows - 1, ctx->row_offset - ctx->shown_offset);
+    ctx->shown_offset = ctx->row_offset;
+    // draw the whole screen into the frame, but only send what changed
+    Frame_clear(frame);
+    draw_rows(ctx, frame);
+    draw_status_bar(ctx, frame);
+    switch (ctx->view) {
+        case VIEW_LATENCY:
+            draw_latency(ctx, frame);
+            break;
+        case VIEW_MEMORY:
+            draw_memory(ctx, frame);
+            break;
+        default:
+            draw_status_msg(ctx, frame);
+    }
+    Frame_flush(frame, ab);
     place_cursor(ctx, ab);
-    Abuf_append(ab, BLINK_CURSOR, sizeof(BLINK_CURSOR));
-    write(STDOUT_FILENO, ab->buf, ab->len);
+    Abuf_append(ab, SHOW_CURSOR, strlen(SHOW_CURSOR));
+    uint64_t drawn = Hist_now();
+    if (Abuf_write(ab, STDOUT_FILENO) == -1) {
+        unix_error("write");
+    }
+    uint64_t done = Hist_now();
+    Hist_record(&lat->render, drawn - start);
+    Hist_record(&lat->write, done - drawn);
+    Hist_record(&lat->bytes, ab->len);
+    if (lat->input_at) {
+        Hist_record(&lat->handle, start - lat->input_at);
+        Hist_record(&lat->total, done - lat->input_at);
+        lat->input_at = 0;
+    }
+    frame->bytes = ab->len;
+    frame->total_bytes += ab->len;
+    frame->frames++;
     Abuf_reset(ab);
 }
 
+// size everything that depends on the window. Called again on resize,
+// after which the whole screen is redrawn.
+void
+screen_init(struct EditorContext* ctx)
+{
+    if (window_size(&ctx->screenrows, &ctx->screencols) == -1) {
+        if (!ctx->batch) {
+            unix_error("init window");
+        }
+        // a batch run edits as if on a standard terminal
+        ctx->screenrows = 24;
+        ctx->screencols = 80;
+    }
+    if (ctx->frame) {
+        Frame_free(ctx->frame);
+        Render_free(ctx->render);
+    }
+    if (ctx->screenrows < 3) {
+        ctx->screenrows = 3;
+    }
+    ctx->frame = Frame_new(ctx->screenrows, ctx->screencols);
+    ctx->screenrows -= 2;
+    // twice the screen, so paging back and forth still hits
+    ctx->render = Render_new(2 * ctx->screenrows + 1);
+    ctx->shown_offset = ctx->row_offset;
+}
+
 void
-init_editor(struct EditorContext* ctx, char* filename, struct BumpAlloc* bmp)
+init_editor(struct EditorContext* ctx,
+            char* filename,
+            struct BumpAlloc* bmp,
+            int batch)
 {
     ctx->bmp = bmp;
+    ctx->batch = batch;
+    ctx->batch_keys = "";
+    ctx->batch_left = 0;
     ctx->cx = 0;
     ctx->cy = 0;
     ctx->rx = 0;
     ctx->row_offset = 0;
+    ctx->shown_offset = 0;
     ctx->col_offset = 0;
-    ctx->n_rows = 0;
-    ctx->lines = NULL;
+    ctx->gap = NULL;
+    ctx->workers = NULL;
+    ctx->save = Bump_alloc(ctx->bmp, sizeof(*ctx->save));
+    ctx->save->state = SAVE_IDLE;
+    ctx->autosave = 0;
+    ctx->last_save = time(NULL);
     ctx->filename = filename;
     ctx->dirty = 0;
     ctx->status_msg[0] = '\0';
     ctx->status_time = 0;
-    if (window_size(&ctx->screenrows, &ctx->screencols) == -1) {
-        unix_error("init window");
+    ctx->events = NULL;
+    ctx->input_pos = ctx->input_len = 0;
+    ctx->idle_pending = 0;
+    ctx->ab = Abuf_new();
+    ctx->undo = Undo_new(UNDO_LIMIT);
+    ctx->search = Bump_alloc(ctx->bmp, sizeof(*ctx->search));
+    ctx->search->len = 0;
+    ctx->regex = NULL;
+    ctx->match = -1;
+    ctx->latency = Mem_alloc(MEM_OTHER, sizeof(*ctx->latency));
+    Hist_init(&ctx->latency->total);
+    Hist_init(&ctx->latency->handle);
+    Hist_init(&ctx->latency->render);
+    Hist_init(&ctx->latency->write);
+    Hist_init(&ctx->latency->bytes);
+    Hist_init(&ctx->latency->save);
+    ctx->latency->input_at = 0;
+    ctx->view = VIEW_STATUS;
+    ctx->frame = NULL;
+    ctx->render = NULL;
+    screen_init(ctx);
+}
+
+// free what init_editor and editing allocated, once any save has finished.
+// The arena, the filename, the events and the workers belong to the caller.
+void
+free_editor(struct EditorContext* ctx)
+{
+    if (ctx->save->state != SAVE_IDLE) {
+        Save_wait(ctx->save);
     }
-    size_t capacity = (ctx->screenrows + 2) * (ctx->screencols + 2);
-    struct Abuf* ab = Bump_alloc(ctx->bmp, sizeof(*ab) + capacity);
-    Abuf_init(ab, capacity);
-    ctx->ab = ab;
-    ctx->screenrows -= 2;
+    if (ctx->save->scratch) {
+        Bump_free(ctx->save->scratch);
+    }
+    if (ctx->gap) {
+        Gap_free(ctx->gap);
+    }
+    if (ctx->regex) {
+        Re_free(ctx->regex);
+    }
+    Undo_free(ctx->undo);
+    Abuf_free(ctx->ab);
+    Frame_free(ctx->frame);
+    Render_free(ctx->render);
+    Mem_free(MEM_OTHER, ctx->latency, sizeof(*ctx->latency));
 }
 
 /***** file i/o *****/
 
+// saves run in the background against a snapshot of the text, see
+// editor_idle for how they are reported
 void
 save_buf(struct EditorContext* ctx)
 {
-    struct BumpAlloc scratch = *ctx->bmp;
-    if (!ctx->filename) {
-        ctx->filename = prompt(ctx, "Save as: %s");
-    }
-
-    int totlen = 0;
-    for (unsigned i = 0; i < ctx->n_rows; i++) {
-        totlen += ctx->lines[i]->size + 1;
-    }
-    int len = totlen;
-    char* buf = Bump_alloc(&scratch, totlen);
-    char* p = buf;
-    for (unsigned i = 0; i < ctx->n_rows; i++) {
-        struct GapBuffer* gap = ctx->lines[i];
-        char* cpy = Bump_alloc(&scratch, gap->size + 1);
-        Gap_str(gap, cpy);
-        memcpy(p, cpy, gap->size);
-        p += gap->size;
-        *p = '\n';
-        p++;
-    }
-    int fd = open(ctx->filename, (O_RDWR | O_CREAT), 0644);
-    if (fd == -1) {
+    if (ctx->save->state != SAVE_IDLE) {
+        set_status(ctx, "a save is already in progress");
         return;
     }
-    if (ftruncate(fd, len) != -1) {
-        if (write(fd, buf, len) == len) {
-            set_status(ctx, "%d bytes written to disk", len);
-            ctx->dirty = 0;
-        } else {
+    if (!ctx->filename) {
+        ctx->filename = prompt(ctx, "Save as: %s", 0);
+        if (!ctx->filename) {
+            set_status(ctx, "save aborted");
+            return;
+        }
+    }
+    uint64_t start = Hist_now();
+    Save_start(ctx->save, ctx->gap, ctx->filename, ctx->dirty);
+    Hist_record(&ctx->latency->save, Hist_now() - start);
+    ctx->last_save = time(NULL);
+}
+
+// report on a running or finished save. Returns 1 if the status changed.
+int
+poll_save(struct EditorContext* ctx)
+{
+    struct SaveJob* job = ctx->save;
+    ssize_t size = job->snapshot ? job->snapshot->size : 0;
+    int dirty = job->dirty;
+    switch (Save_poll(job)) {
+        case SAVE_RUNNING: {
+            ssize_t written = __atomic_load_n(&job->written, __ATOMIC_RELAXED);
             set_status(ctx,
-                       "failed to write some or all of buffer: %s",
-                       strerror(errno));
+                       "saving: %zd%%",
+                       size ? written * 100 / size : (ssize_t)100);
+            return 1;
         }
+        case SAVE_DONE:
+            set_status(ctx, "%zd bytes written to disk", size);
+            // edits made while saving still count as unsaved
+            ctx->dirty -= dirty;
+            return 1;
+        case SAVE_FAILED:
+            set_status(ctx, "failed to save buffer: %s", strerror(job->err));
+            return 1;
+        default:
+            return 0;
     }
-    close(fd);
 }
 
+// Regular files are mapped rather than read, and only the lines needed for
+// the first screen are indexed up front. The rest is indexed while idle.
 void
 file_open(struct EditorContext* ctx, char* filename)
 {
+    int map_fd = open(filename, O_RDONLY);
+    if (map_fd != -1) {
+        struct stat st;
+        if (fstat(map_fd, &st) != -1 && S_ISREG(st.st_mode) &&
+            st.st_size > 0) {
+            ctx->gap = Gap_map(map_fd, st.st_size);
+        }
+        close(map_fd);
+        if (ctx->gap) {
+            ctx->dirty = 0;
+            return;
+        }
+    }
+    struct GapBuffer* buf = Gap_new("");
+    ctx->gap = buf;
     FILE* fd = fopen(filename, "r");
     if (!fd) {
         return;
     }
-    char* line = NULL;
-    size_t line_cap = 0;
-    int line_len;
-    struct GapBuffer* buf = Gap_new("");
-    while ((line_len = getline(&line, &line_cap, fd)) != -1) {
-        Gap_insert_str(buf, line);
-        while (line_len > 0 &&
-               (line[line_len - 1] == '\n' || line[line_len - 1] == '\r')) {
-            line_len--;
-            line[line_len] = '\0';
-        }
-        insert_row(ctx, ctx->n_rows, line);
+    char chunk[KILOBYTES(64)];
+    size_t nread;
+    while ((nread = fread(chunk, 1, sizeof(chunk), fd)) > 0) {
+        Gap_insert(buf, chunk, nread);
     }
-    ctx->gap = buf;
+    fclose(fd);
     Gap_mov(buf, -buf->size);
     ctx->dirty = 0;
 }
@@ -366,38 +715,104 @@ enum EditorKey
     END,
     PG_UP,
     PG_DWN,
-    DEL
+    DEL,
+    PASTE
 };
 
+// how long to wait for the rest of an escape sequence before taking the
+// escape as a key of its own
+#define ESC_WAIT_MS (50)
+
+// read whatever input is available into the input buffer. Returns 0 if
+// nothing was read. A batch run reads the keys its script types instead.
+int
+fill_input(struct EditorContext* ctx)
+{
+    if (ctx->input_pos == ctx->input_len) {
+        ctx->input_pos = ctx->input_len = 0;
+    }
+    ssize_t room = sizeof(ctx->input) - ctx->input_len;
+    ssize_t nread;
+    if (ctx->batch) {
+        nread = ctx->batch_left < room ? ctx->batch_left : room;
+        memcpy(&ctx->input[ctx->input_len], ctx->batch_keys, nread);
+        ctx->batch_keys += nread;
+        ctx->batch_left -= nread;
+    } else {
+        nread = read(STDIN_FILENO, &ctx->input[ctx->input_len], room);
+    }
+    // EIO means the terminal hung up, which the event loop handles
+    if (nread == -1 && errno != EAGAIN && errno != EINTR && errno != EIO) {
+        unix_error("read");
+    }
+    if (nread > 0) {
+        ctx->input_len += nread;
+        if (!ctx->latency->input_at) {
+            ctx->latency->input_at = Hist_now();
+        }
+    }
+    return nread > 0;
+}
+
+// wait up to `ms` for more input and read it. Returns 0 if none came.
+static int
+wait_input(struct EditorContext* ctx, int ms)
+{
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+    if (!ctx->batch && poll(&pfd, 1, ms) != 1) {
+        return 0;
+    }
+    return fill_input(ctx);
+}
+
+// the next byte of an escape sequence, waiting briefly for it to arrive
+int
+next_byte(struct EditorContext* ctx, char* c)
+{
+    if (ctx->input_pos == ctx->input_len && !wait_input(ctx, ESC_WAIT_MS)) {
+        return 0;
+    }
+    *c = ctx->input[ctx->input_pos++];
+    return 1;
+}
+
 int
-char_to_key(char c)
+char_to_key(struct EditorContext* ctx, char c)
 {
     if (c == '\x1b') {
         char seq[3];
-        if (read(STDIN_FILENO, seq, 1) != 1)
+        if (!next_byte(ctx, &seq[0]))
             return '\x1b';
-        if (read(STDIN_FILENO, seq + 1, 1) != 1)
+        if (!next_byte(ctx, &seq[1]))
             return '\x1b';
         if (seq[0] == '[') {
             if (seq[1] >= '0' && seq[1] <= '9') {
-                if (read(STDIN_FILENO, seq + 2, 1) != 1)
+                int code = seq[1] - '0';
+                if (!next_byte(ctx, &seq[2]))
                     return '\x1b';
+                while (seq[2] >= '0' && seq[2] <= '9') {
+                    code = code * 10 + seq[2] - '0';
+                    if (!next_byte(ctx, &seq[2]))
+                        return '\x1b';
+                }
                 if (seq[2] == '~') {
-                    switch (seq[1]) {
-                        case '1':
+                    switch (code) {
+                        case 1:
                             return HOME;
-                        case '3':
+                        case 3:
                             return DEL;
-                        case '4':
+                        case 4:
                             return END;
-                        case '5':
+                        case 5:
                             return PG_UP;
-                        case '6':
+                        case 6:
                             return PG_DWN;
-                        case '7':
+                        case 7:
                             return HOME;
-                        case '8':
+                        case 8:
                             return END;
+                        case 200:
+                            return PASTE;
                         default:
                             return '\x1b';
                     }
@@ -439,42 +854,131 @@ char_to_key(char c)
     }
 }
 
+// housekeeping done while no input is pending. Returns 1 if the screen
+// needs to be redrawn.
+int
+editor_idle(struct EditorContext* ctx)
+{
+    ctx->idle_pending = 0;
+    Gap_shrink(ctx->gap);
+    int redraw = poll_save(ctx);
+    if (ctx->autosave && ctx->dirty && ctx->filename &&
+        ctx->save->state == SAVE_IDLE &&
+        time(NULL) - ctx->last_save >= ctx->autosave) {
+        save_buf(ctx);
+        redraw = 1;
+    }
+    // a batch run indexes only as far as it looks
+    if (Gap_index_done(ctx->gap) || ctx->batch) {
+        return redraw;
+    }
+    // index in chunks until done or a key is pressed
+    ssize_t step = MEGABYTES(4);
+    if (ctx->workers) {
+        step *= Work_threads(ctx->workers);
+    }
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+    while (Gap_index_step(ctx->gap, step) && !poll(&pfd, 1, 0))
+        ;
+    return 1;
+}
+
+// how often a running save reports its progress
+#define SAVE_POLL_MS (100)
+
+// how long the event loop may sleep before editor_idle has work to do, in
+// ms, or -1 to sleep until something happens
+int
+idle_timeout(struct EditorContext* ctx)
+{
+    if (ctx->idle_pending || !Gap_index_done(ctx->gap)) {
+        return 0;
+    } else if (ctx->save->state != SAVE_IDLE) {
+        return SAVE_POLL_MS;
+    } else if (ctx->autosave && ctx->dirty && ctx->filename) {
+        time_t left = ctx->last_save + ctx->autosave - time(NULL);
+        return left > 0 ? left * 1000 : 0;
+    }
+    return -1;
+}
+
+void
+quit(struct EditorContext* ctx, int status)
+{
+    if (ctx->save->state != SAVE_IDLE) {
+        set_status(ctx, "waiting for save to finish");
+        refresh_ui(ctx);
+        Save_wait(ctx->save);
+    }
+    exit(status);
+}
+
+// whether more input is ready without waiting
+int
+input_pending(struct EditorContext* ctx)
+{
+    return ctx->input_pos < ctx->input_len || fill_input(ctx);
+}
+
+// sleep until input arrives, handling resizes, the status timer and idle
+// work in the meantime
 char
-read_input(void)
+read_input(struct EditorContext* ctx)
 {
-    int nread;
-    char c;
-    while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-        if (nread == -1 && errno != EAGAIN) {
-            unix_error("read");
+    while (ctx->input_pos == ctx->input_len) {
+        if (ctx->batch) {
+            // out of keys: whatever is waiting for one is cancelled
+            if (!fill_input(ctx)) {
+                return '\x1b';
+            }
+            continue;
+        }
+        int events = Event_wait(ctx->events, idle_timeout(ctx));
+        if (events & EVENT_RESIZE) {
+            screen_init(ctx);
+        }
+        if (events & EVENT_INPUT) {
+            if (!fill_input(ctx) && (events & EVENT_HANGUP)) {
+                quit(ctx, EXIT_FAILURE);
+            }
+        } else if (events & (EVENT_RESIZE | EVENT_TIMER)) {
+            refresh_ui(ctx);
+        } else if (editor_idle(ctx)) {
+            refresh_ui(ctx);
         }
     }
-    return c;
+    // keys left over from the last batch arrive now, as far as latency goes
+    if (!ctx->latency->input_at) {
+        ctx->latency->input_at = Hist_now();
+    }
+    return ctx->input[ctx->input_pos++];
 }
 
+// a line typed in the message bar, or NULL if Escape is pressed. It is
+// allocated to fit, for the caller to free with Mem_free(MEM_OTHER).
 char*
-prompt(struct EditorContext* ctx, char* prompt)
+prompt(struct EditorContext* ctx, char* prompt, int empty_ok)
 {
     size_t bufsize = 128;
-    char* buf = Calloc(1, bufsize);
+    char* buf = Mem_calloc(MEM_OTHER, 1, bufsize);
     size_t buflen = 0;
     while (1) {
         set_status(ctx, prompt, buf);
         refresh_ui(ctx);
-        int c = read_input();
+        int c = read_input(ctx);
         if (c == '\x1b') {
             set_status(ctx, "");
-            free(buf);
+            Mem_free(MEM_OTHER, buf, bufsize);
             return NULL;
         } else if (c == '\r') {
-            if (buflen != 0) {
+            if (buflen != 0 || empty_ok) {
                 set_status(ctx, "");
-                return buf;
+                return Mem_realloc(MEM_OTHER, buf, bufsize, buflen + 1);
             }
         } else if (!iscntrl(c) && c < 128) {
             if (buflen == bufsize - 1) {
+                buf = Mem_realloc(MEM_OTHER, buf, bufsize, 2 * bufsize);
                 bufsize *= 2;
-                buf = Realloc(buf, bufsize);
             }
             buf[buflen++] = c;
             buf[buflen] = '\0';
@@ -482,71 +986,134 @@ prompt(struct EditorContext* ctx, char* prompt)
     }
 }
 
+// Incremental search for a literal pattern, or a regular expression if
+// `regex` is set: each key typed finds the pattern again, starting at the
+// current match. Arrows go to the next or previous match, wrapping around
+// the text, Enter stays at the match and Escape goes back to where the
+// search started. Ctrl-G asks for a replacement and replaces every match.
+void
+find(struct EditorContext* ctx, int regex)
+{
+    struct GapBuffer* gap = ctx->gap;
+    ssize_t start = cursor_offset(ctx);
+    ssize_t row_offset = ctx->row_offset;
+    ssize_t col_offset = ctx->col_offset;
+    char pat[SEARCH_MAX];
+    ssize_t len = 0;
+    ssize_t at = start;
+    const char* err = NULL;
+    char* with = NULL;
+    int key = 0;
+    Undo_seal(ctx->undo);
+    while (key != '\x1b' && key != '\r') {
+        set_status(ctx,
+                   "%s: %.*s%s%s",
+                   regex ? "Regex search" : "Search",
+                   (int)len,
+                   pat,
+                   err ? " - " : len && ctx->match == -1 ? " (not found)" : "",
+                   err ? err : "");
+        refresh_ui(ctx);
+        key = char_to_key(ctx, read_input(ctx));
+        int dir = 0;
+        if (key == '\x1b' || key == '\r') {
+            continue;
+        } else if (key == BACKSPACE || key == CTRL_KEY('h')) {
+            len -= len > 0;
+        } else if (key == DOWN || key == RIGHT || key == CTRL_KEY('f') ||
+                   key == CTRL_KEY('r')) {
+            dir = 1;
+        } else if (key == UP || key == LEFT) {
+            dir = -1;
+        } else if (key == CTRL_KEY('g') && len && !err) {
+            with = prompt(ctx, "Replace all with: %s", 1);
+            key = with ? '\r' : 0;
+            continue;
+        } else if (key < 128 && !iscntrl(key) && len < SEARCH_MAX) {
+            pat[len++] = key;
+        } else {
+            continue;
+        }
+        if (!regex) {
+            Search_init(ctx->search, pat, len);
+        } else if (!dir) {
+            if (ctx->regex) {
+                Re_free(ctx->regex);
+            }
+            ctx->regex = len ? Re_compile(pat, len, &err) : NULL;
+            err = len ? err : NULL;
+        }
+        ssize_t found = -1;
+        ssize_t end;
+        if (dir >= 0) {
+            found = match_first(ctx, at + dir, gap->size, &end);
+            if (found == -1) {
+                found = match_first(ctx, 0, gap->size, &end);
+            }
+        } else {
+            found = match_before(ctx, at, &end);
+            if (found == -1) {
+                found = match_before(ctx, gap->size, &end);
+            }
+        }
+        ctx->match = found;
+        at = found == -1 ? at : found;
+        cursor_set(ctx, len ? at : start);
+    }
+    if (key == '\x1b') {
+        cursor_set(ctx, start);
+        ctx->row_offset = row_offset;
+        ctx->col_offset = col_offset;
+    }
+    if (ctx->regex) {
+        Re_free(ctx->regex);
+        ctx->regex = NULL;
+    }
+    ctx->search->len = 0;
+    ctx->match = -1;
+    set_status(ctx, "");
+    if (with) {
+        replace_all(ctx, pat, len, regex, with);
+        Mem_free(MEM_OTHER, with, strlen(with) + 1);
+    }
+}
+
 void
 handle_cursor_mov(struct EditorContext* ctx, int key)
 {
-    struct GapBuffer* gap =
-      (ctx->cy >= ctx->n_rows) ? NULL : ctx->lines[ctx->cy];
+    struct GapBuffer* gap = ctx->gap;
     switch (key) {
         case LEFT:
-            Gap_mov(ctx->gap, -1);
-            if (gap && ctx->cx > 0) {
+            if (ctx->cx > 0) {
                 ctx->cx--;
-                Gap_mov(gap, -1);
             } else if (ctx->cy > 0) {
                 ctx->cy--;
-                struct GapBuffer* prev = ctx->lines[ctx->cy];
-                ctx->cx = prev->size;
-                Gap_mov(prev, prev->size);
+                ctx->cx = Gap_line_len(gap, ctx->cy);
             }
             break;
         case RIGHT:
-            Gap_mov(ctx->gap, +1);
-            if (gap && ctx->cx < gap->size) {
+            if (ctx->cx < Gap_line_len(gap, ctx->cy)) {
                 ctx->cx++;
-                Gap_mov(gap, 1);
-            } else if (gap && ctx->cx >= gap->size) {
+            } else if (ctx->cy + 1 < Gap_index_lines(gap, ctx->cy + 1)) {
                 ctx->cy++;
-                if (ctx->cy < ctx->n_rows) {
-                    struct GapBuffer* next = ctx->lines[ctx->cy];
-                    Gap_mov(next, -next->size);
-                }
                 ctx->cx = 0;
             }
             break;
         case UP:
             if (ctx->cy > 0) {
                 ctx->cy--;
-                struct GapBuffer* prev = ctx->lines[ctx->cy];
-                Gap_mov(prev, ctx->cx - prev->cur_beg);
             }
-            Gap_prevline(ctx->gap);
             break;
         case DOWN:
-            if (ctx->cy < ctx->n_rows) {
+            if (ctx->cy + 1 < Gap_index_lines(gap, ctx->cy + 1)) {
                 ctx->cy++;
-                if (ctx->cy < ctx->n_rows) {
-                    struct GapBuffer* next = ctx->lines[ctx->cy];
-                    Gap_mov(next, ctx->cx - next->cur_beg);
-                } else {
-                    ctx->cx = 0;
-                }
             }
-            Gap_nextline(ctx->gap);
             break;
         case HOME:
             ctx->cy = 0;
-            struct GapBuffer* first = ctx->lines[ctx->cy];
-            Gap_mov(first, ctx->cx - first->cur_beg);
-            Gap_mov(ctx->gap, -ctx->gap->size);
             break;
         case END:
-            ctx->cy = ctx->n_rows - 1;
-            {
-                struct GapBuffer* last = ctx->lines[ctx->cy];
-                Gap_mov(last, ctx->cx - last->cur_beg);
-            }
-            Gap_mov(ctx->gap, ctx->gap->size);
+            ctx->cy = Gap_lines(gap) - 1;
             break;
         case PG_UP:
             if (ctx->cy < ctx->screenrows) {
@@ -554,28 +1121,17 @@ handle_cursor_mov(struct EditorContext* ctx, int key)
             } else {
                 ctx->cy -= ctx->screenrows;
             }
-            struct GapBuffer* up = ctx->lines[ctx->cy];
-            Gap_mov(up, ctx->cx - up->cur_beg);
-            for (ssize_t i = 0; i < ctx->screenrows; i++) {
-                Gap_prevline(ctx->gap);
-            }
             break;
-        case PG_DWN:
+        case PG_DWN: {
+            ssize_t last = Gap_index_lines(gap, ctx->cy + ctx->screenrows) - 1;
             ctx->cy += ctx->screenrows;
-            if (ctx->cy > ctx->n_rows) {
-                ctx->cy = ctx->n_rows;
-            }
-            {
-                struct GapBuffer* down = ctx->lines[ctx->cy];
-                Gap_mov(down, ctx->cx - down->cur_beg);
-            }
-            for (ssize_t i = 0; i < ctx->screenrows; i++) {
-                Gap_nextline(ctx->gap);
+            if (ctx->cy > last) {
+                ctx->cy = last;
             }
             break;
+        }
     }
-    gap = (ctx->cy >= ctx->n_rows) ? NULL : ctx->lines[ctx->cy];
-    unsigned rowlen = gap ? gap->size : 0;
+    ssize_t rowlen = Gap_line_len(gap, ctx->cy);
     if (ctx->cx > rowlen) {
         ctx->cx = rowlen;
     }
@@ -584,68 +1140,91 @@ handle_cursor_mov(struct EditorContext* ctx, int key)
 void
 enter_char(struct EditorContext* ctx, char c)
 {
-    if (ctx->cy == ctx->n_rows) {
-        insert_row(ctx, ctx->n_rows, "");
+    text_insert(ctx, cursor_offset(ctx), &c, 1);
+}
+
+// how long a paste may stall before what arrived so far is inserted
+#define PASTE_WAIT_MS (1000)
+#define PASTE_END ("\x1b[201~")
+
+static char*
+find_paste_end(char* from, char* to)
+{
+    const ssize_t end_len = strlen(PASTE_END);
+    char* esc;
+    while ((esc = memchr(from, '\x1b', to - from))) {
+        if (to - esc >= end_len && !memcmp(esc, PASTE_END, end_len)) {
+            return esc;
+        }
+        from = esc + 1;
     }
-    Gap_insert_chr(ctx->lines[ctx->cy], c);
-    Gap_insert_chr(ctx->gap, c);
-    ctx->cx++;
-    ctx->dirty++;
+    return NULL;
+}
+
+// collect a bracketed paste up to its end marker and insert it as one
+// edit, with the terminal's carriage returns turned back into newlines
+void
+enter_paste(struct EditorContext* ctx)
+{
+    const ssize_t end_len = strlen(PASTE_END);
+    ssize_t cap = sizeof(ctx->input);
+    char* buf = Mem_alloc(MEM_SCRATCH, cap);
+    ssize_t len = 0;
+    char* end = NULL;
+    while (!end) {
+        if (ctx->input_pos == ctx->input_len &&
+            !wait_input(ctx, PASTE_WAIT_MS)) {
+            break;
+        }
+        ssize_t n = ctx->input_len - ctx->input_pos;
+        if (len + n > cap) {
+            buf = Mem_realloc(MEM_SCRATCH, buf, cap, 2 * (len + n));
+            cap = 2 * (len + n);
+        }
+        memcpy(&buf[len], &ctx->input[ctx->input_pos], n);
+        ctx->input_pos = ctx->input_len;
+        // the marker may have been split across reads
+        ssize_t from = len > end_len ? len - end_len : 0;
+        len += n;
+        end = find_paste_end(&buf[from], &buf[len]);
+        if (end) {
+            // give back whatever followed the paste
+            ctx->input_pos -= len - (end - buf + end_len);
+            len = end - buf;
+        }
+    }
+    ssize_t out = 0;
+    for (ssize_t i = 0; i < len; i++) {
+        if (buf[i] != '\r') {
+            buf[out++] = buf[i];
+        } else if (i + 1 == len || buf[i + 1] != '\n') {
+            buf[out++] = '\n';
+        }
+    }
+    if (out) {
+        text_insert(ctx, cursor_offset(ctx), buf, out);
+    }
+    Mem_free(MEM_SCRATCH, buf, cap);
 }
 
 void
 enter_newline(struct EditorContext* ctx)
 {
-    struct BumpAlloc scratch = *ctx->bmp;
-    if (ctx->cx == 0) {
-        insert_row(ctx, ctx->cy, "");
-    } else {
-        struct GapBuffer* gap = ctx->lines[ctx->cy];
-        char* buf = Bump_alloc(&scratch, gap->size - ctx->cx + 1);
-        Gap_substr(gap, ctx->cx, gap->size, buf);
-        insert_row(ctx, ctx->cy + 1, buf);
-        Gap_del(gap, gap->size);
-    }
-    Gap_insert_chr(ctx->gap, '\n');
-    ctx->cy++;
-    ctx->cx = 0;
+    text_insert(ctx, cursor_offset(ctx), "\n", 1);
 }
 
 void
 del_char(struct EditorContext* ctx)
 {
-    if (ctx->cy == ctx->n_rows) {
-        return;
-    }
-    if (ctx->gap->cur_beg == ctx->gap->size) {
-        return;
-    }
-
-    struct GapBuffer* curr = ctx->lines[ctx->cy];
-    if (ctx->cy == ctx->n_rows - 1 && ctx->cx == curr->size) {
-        return;
-    } else if (ctx->cx < curr->size) {
-        Gap_del(curr, 1);
-        Gap_del(ctx->gap, 1);
-        ctx->dirty++;
-    } else {
-        if (ctx->cy > 1) {
-            Gap_del(ctx->gap, 1);
-        }
-        struct BumpAlloc scratch = *ctx->bmp;
-        struct GapBuffer* next = ctx->lines[ctx->cy + 1];
-        char* buf = Bump_alloc(&scratch, next->size + 1);
-        Gap_str(next, buf);
-        Gap_insert_str(curr, buf);
-        Gap_mov(curr, -strlen(buf));
-        del_row(ctx, ctx->cy + 1);
-        ctx->dirty++;
+    ssize_t at = cursor_offset(ctx);
+    if (at < ctx->gap->size) {
+        text_delete(ctx, at, 1);
     }
 }
 void
 handle_input(struct EditorContext* ctx, char c)
 {
-    int key = char_to_key(c);
+    int key = char_to_key(ctx, c);
     switch (key) {
         case LEFT:
         case RIGHT:
@@ -655,11 +1234,16 @@ handle_input(struct EditorContext* ctx, char c)
         case PG_UP:
         case END:
         case HOME:
+            // typing somewhere else is a new edit
+            Undo_seal(ctx->undo);
             handle_cursor_mov(ctx, key);
             break;
         case '\r':
             enter_newline(ctx);
             break;
+        case PASTE:
+            enter_paste(ctx);
+            break;
         case CTRL_KEY('s'):
             save_buf(ctx);
             break;
@@ -668,13 +1252,29 @@ handle_input(struct EditorContext* ctx, char c)
             if (!ctx->cx && !ctx->cy) {
                 break;
             }
+            // moving back over the byte keeps a run of backspaces open
             handle_cursor_mov(ctx, LEFT);
             // fall through
         case DEL:
             del_char(ctx);
             break;
         case CTRL_KEY('q'):
-            exit(0);
+            quit(ctx, EXIT_SUCCESS);
+            break;
+        case CTRL_KEY('f'):
+            find(ctx, 0);
+            break;
+        case CTRL_KEY('r'):
+            find(ctx, 1);
+            break;
+        case CTRL_KEY('z'):
+            undo(ctx);
+            break;
+        case CTRL_KEY('y'):
+            redo(ctx);
+            break;
+        case CTRL_KEY('t'):
+            ctx->view = (ctx->view + 1) % VIEW_COUNT;
             break;
         case CTRL_KEY('l'):
         case '\x1b':
@@ -1,36 +1,106 @@
 #ifndef EDITOR
 #define EDITOR
 
+#include "hist.h"
 #include <sys/types.h>
 #include <time.h>
+
+// keystroke to paint latency, recorded by refresh_ui
+struct Latency
+{
+    struct Hist total;  // from a key arriving to its frame being written
+    struct Hist handle; // from a key arriving to the frame being started
+    struct Hist render; // drawing and diffing a frame
+    struct Hist write;  // writing a frame to the terminal
+    struct Hist bytes;  // bytes written per frame
+    struct Hist save;   // starting a save, before its thread takes over
+    uint64_t input_at;  // when the first key of the next frame arrived
+};
+
+// what the message line shows, cycled with Ctrl-T
+enum InfoView
+{
+    VIEW_STATUS,
+    VIEW_LATENCY,
+    VIEW_MEMORY,
+    VIEW_COUNT
+};
+
 struct EditorContext
 {
     struct BumpAlloc* bmp;
     ssize_t cx, cy;
     ssize_t rx;
     ssize_t row_offset, col_offset;
+    ssize_t shown_offset; // row_offset of the frame on the terminal
     ssize_t screenrows;
     ssize_t screencols;
-    ssize_t n_rows;
     int dirty;
     char status_msg[80];
     time_t status_time;
     struct GapBuffer* gap;
-    struct GapBuffer** lines;
     char* filename;
     struct Abuf* ab;
+    struct Frame* frame;
+    struct RenderCache* render;
+    struct EventLoop* events;
+    char input[4096]; // keys read but not handled yet
+    ssize_t input_pos, input_len;
+    int idle_pending; // editor_idle has work to do since the last edit
+    struct Latency* latency;
+    enum InfoView view;
+    struct UndoLog* undo;
+    struct Search* search; // highlighted while searching, if len is not 0
+    struct Regex* regex;   // or this, while searching for a regex
+    ssize_t match;         // offset of the current match, -1 if none
+    struct WorkPool* workers;
+    struct SaveJob* save;
+    int autosave; // seconds between autosaves, 0 to disable
+    time_t last_save;
+    int batch;              // run from a script, with no terminal
+    const char* batch_keys; // keys the script types next, see Batch_run
+    ssize_t batch_left;
 };
 
 void
-init_editor(struct EditorContext* ctx, char* filename, struct BumpAlloc* bmp);
+init_editor(struct EditorContext* ctx,
+            char* filename,
+            struct BumpAlloc* bmp,
+            int batch);
+void
+free_editor(struct EditorContext* ctx);
 void
 file_open(struct EditorContext* ctx, char* filename);
 void
+screen_init(struct EditorContext* ctx);
+void
 set_status(struct EditorContext* ctx, const char* fmt, ...);
 void
 refresh_ui(struct EditorContext* ctx);
 char
-read_input(void);
+read_input(struct EditorContext* ctx);
+int
+input_pending(struct EditorContext* ctx);
 void
 handle_input(struct EditorContext* ctx, char c);
+int
+editor_idle(struct EditorContext* ctx);
+void
+quit(struct EditorContext* ctx, int status);
+ssize_t
+cursor_offset(struct EditorContext* ctx);
+void
+text_insert(struct EditorContext* ctx, ssize_t at, const char* s, ssize_t len);
+void
+text_delete(struct EditorContext* ctx, ssize_t at, ssize_t len);
+void
+undo(struct EditorContext* ctx);
+void
+redo(struct EditorContext* ctx);
+void
+replace_all(struct EditorContext* ctx,
+            const char* pat,
+            ssize_t len,
+            int regex,
+            const char* with);
 #endif // !EDITOR
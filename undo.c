@@ -0,0 +1,280 @@
+#include "undo.h"
+#include "gap.h"
+#include <string.h>
+
+#define UNDO_ALIGN (sizeof(ssize_t))
+
+// room for the header, the bytes and the '\0' Gap_substr adds after them
+static size_t
+record_size(ssize_t len)
+{
+    size_t size = sizeof(struct UndoRecord) + len + 1;
+    return (size + UNDO_ALIGN - 1) / UNDO_ALIGN * UNDO_ALIGN;
+}
+
+static struct UndoRecord*
+record_at(struct UndoLog* log, size_t offset)
+{
+    return (struct UndoRecord*)&log->buf[offset];
+}
+
+static void
+reserve(struct UndoLog* log, size_t size)
+{
+    if (size <= log->cap) {
+        return;
+    }
+    size_t cap = log->cap ? 2 * log->cap : KILOBYTES(4);
+    if (cap > log->limit) {
+        cap = log->limit;
+    }
+    if (cap < size) {
+        cap = size;
+    }
+    log->buf = Mem_realloc(MEM_UNDO, log->buf, log->cap, cap);
+    log->cap = cap;
+}
+
+static void
+clear(struct UndoLog* log)
+{
+    log->used = log->pos = log->top = 0;
+    log->open = 0;
+}
+
+// drop the oldest records until `need` more bytes fit. A quarter of the
+// limit is freed at a time, so the move is paid for once in a while.
+static void
+drop_oldest(struct UndoLog* log, size_t need)
+{
+    if (need > log->limit) {
+        clear(log);
+        return;
+    }
+    size_t keep = log->limit - need;
+    keep -= keep > log->limit / 4 ? log->limit / 4 : keep;
+    size_t drop = 0;
+    while (drop < log->used && log->used - drop > keep) {
+        drop += record_at(log, drop)->size;
+    }
+    if (drop == log->used) {
+        clear(log);
+        return;
+    }
+    memmove(log->buf, &log->buf[drop], log->used - drop);
+    log->used -= drop;
+    log->pos -= drop;
+    log->top -= drop;
+    record_at(log, 0)->prev = 0;
+}
+
+// a new record at the end of the log. Anything that could be redone is
+// lost. Returns NULL if the edit is too big to keep at all, in which case
+// the whole history is dropped, as it no longer leads to the current text.
+static struct UndoRecord*
+push(struct UndoLog* log, int kind, ssize_t at, ssize_t len)
+{
+    log->used = log->pos;
+    size_t size = record_size(len);
+    if (log->used + size > log->limit) {
+        drop_oldest(log, size);
+        if (size > log->limit) {
+            return NULL;
+        }
+    }
+    reserve(log, log->used + size);
+    struct UndoRecord* rec = record_at(log, log->used);
+    rec->prev = log->used ? record_at(log, log->top)->size : 0;
+    rec->size = size;
+    rec->at = at;
+    rec->len = len;
+    rec->kind = kind;
+    log->top = log->used;
+    log->used = log->pos = log->used + size;
+    return rec;
+}
+
+// the last record, grown by one byte, if a single byte edit of `kind` at
+// `at` continues it. NULL if the edit needs a record of its own.
+static struct UndoRecord*
+continue_run(struct UndoLog* log, int kind, ssize_t at)
+{
+    if (!log->open || log->pos != log->used) {
+        return NULL;
+    }
+    struct UndoRecord* rec = record_at(log, log->top);
+    int next = kind == UNDO_INSERT ? at == rec->at + rec->len
+                                   : at == rec->at || at + 1 == rec->at;
+    size_t size = record_size(rec->len + 1);
+    if (rec->kind != kind || !next || rec->len >= UNDO_RUN ||
+        log->top + size > log->limit) {
+        return NULL;
+    }
+    reserve(log, log->top + size);
+    rec = record_at(log, log->top);
+    rec->size = size;
+    log->used = log->pos = log->top + size;
+    return rec;
+}
+
+struct UndoLog*
+Undo_new(size_t limit)
+{
+    struct UndoLog* log = Mem_alloc(MEM_UNDO, sizeof(*log));
+    log->buf = NULL;
+    log->cap = 0;
+    log->limit = limit;
+    clear(log);
+    return log;
+}
+
+void
+Undo_free(struct UndoLog* log)
+{
+    Mem_free(MEM_UNDO, log->buf, log->cap);
+    Mem_free(MEM_UNDO, log, sizeof(*log));
+}
+
+// record `len` bytes inserted at `at`. Typing continues the record of the
+// character before it, up to the end of a line.
+void
+Undo_insert(struct UndoLog* log, ssize_t at, const char* s, ssize_t len)
+{
+    struct UndoRecord* rec =
+      len == 1 ? continue_run(log, UNDO_INSERT, at) : NULL;
+    if (rec) {
+        rec->data[rec->len++] = *s;
+    } else if ((rec = push(log, UNDO_INSERT, at, len))) {
+        memcpy(rec->data, s, len);
+    }
+    log->open = rec && len == 1 && *s != '\n';
+}
+
+// record the `len` bytes at `at` as deleted. Call before deleting them.
+// Runs of backspace or delete continue the record before them.
+void
+Undo_delete(struct UndoLog* log,
+            struct GapBuffer* gap,
+            ssize_t at,
+            ssize_t len)
+{
+    struct UndoRecord* rec =
+      len == 1 ? continue_run(log, UNDO_DELETE, at) : NULL;
+    if (!rec) {
+        rec = push(log, UNDO_DELETE, at, len);
+        if (rec) {
+            Gap_substr(gap, at, at + len, rec->data);
+        }
+        log->open = rec && len == 1;
+        return;
+    }
+    if (at == rec->at) {
+        // delete: the byte follows the run
+        Gap_substr(gap, at, at + 1, &rec->data[rec->len]);
+    } else {
+        // backspace: the byte comes before the run
+        char c[2];
+        Gap_substr(gap, at, at + 1, c);
+        memmove(&rec->data[1], rec->data, rec->len);
+        rec->data[0] = c[0];
+        rec->at = at;
+    }
+    rec->len++;
+}
+
+// Record a replace, before it is made: each of the `n` edits puts the same
+// bytes in place of a match. Returns 0 if it was too big to keep, in which
+// case the history is gone.
+int
+Undo_replace(struct UndoLog* log,
+             struct GapBuffer* gap,
+             const struct GapEdit* edits,
+             ssize_t n)
+{
+    ssize_t len = sizeof(struct UndoReplace) + n * sizeof(struct UndoMatch);
+    len += edits[0].with_len;
+    for (ssize_t i = 0; i < n; i++) {
+        len += edits[i].len;
+    }
+    struct UndoRecord* rec = push(log, UNDO_REPLACE, edits[0].at, len);
+    log->open = 0;
+    if (!rec) {
+        return 0;
+    }
+    struct UndoReplace* rep = (struct UndoReplace*)rec->data;
+    rep->count = n;
+    rep->with_len = edits[0].with_len;
+    char* bytes = (char*)&rep->match[n];
+    memcpy(bytes, edits[0].with, rep->with_len);
+    bytes += rep->with_len;
+    for (ssize_t i = 0; i < n; i++) {
+        rep->match[i].at = edits[i].at;
+        rep->match[i].len = edits[i].len;
+        Gap_substr(gap, edits[i].at, edits[i].at + edits[i].len, bytes);
+        bytes += edits[i].len;
+    }
+    return 1;
+}
+
+// The edits that make a replace again, or revert it, for Gap_splice. They
+// point into the record and are allocated from MEM_SCRATCH, with as many
+// entries as the replace has matches.
+struct GapEdit*
+Undo_replace_edits(struct UndoRecord* rec, int revert)
+{
+    struct UndoReplace* rep = (struct UndoReplace*)rec->data;
+    struct GapEdit* edits =
+      Mem_alloc(MEM_SCRATCH, rep->count * sizeof(struct GapEdit));
+    const char* with = (const char*)&rep->match[rep->count];
+    const char* old = with + rep->with_len;
+    ssize_t shift = 0;
+    for (ssize_t i = 0; i < rep->count; i++) {
+        struct UndoMatch* m = &rep->match[i];
+        if (revert) {
+            // the replacement, where it ended up, goes back to the match
+            edits[i] = (struct GapEdit){ m->at + shift, rep->with_len, old,
+                                         m->len };
+        } else {
+            edits[i] =
+              (struct GapEdit){ m->at, m->len, with, rep->with_len };
+        }
+        shift += rep->with_len - m->len;
+        old += m->len;
+    }
+    return edits;
+}
+
+// end the current run of typing, so the next edit starts a new record
+void
+Undo_seal(struct UndoLog* log)
+{
+    log->open = 0;
+}
+
+// the record to revert, or NULL if there is nothing left to undo
+struct UndoRecord*
+Undo_undo(struct UndoLog* log)
+{
+    if (!log->pos) {
+        return NULL;
+    }
+    struct UndoRecord* rec = record_at(log, log->top);
+    log->pos = log->top;
+    log->top -= rec->prev;
+    log->open = 0;
+    return rec;
+}
+
+// the record to apply again, or NULL if there is nothing to redo
+struct UndoRecord*
+Undo_redo(struct UndoLog* log)
+{
+    if (log->pos == log->used) {
+        return NULL;
+    }
+    struct UndoRecord* rec = record_at(log, log->pos);
+    log->top = log->pos;
+    log->pos += rec->size;
+    log->open = 0;
+    return rec;
+}
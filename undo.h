@@ -0,0 +1,99 @@
+#ifndef UNDO_LOG
+#define UNDO_LOG
+#include "mem.h"
+#include <stdlib.h>
+#include <sys/types.h>
+
+// default cap on the memory held by the log
+#define UNDO_LIMIT (MEGABYTES((size_t)64))
+
+// longest run of typing merged into one record
+#define UNDO_RUN (256)
+
+struct GapBuffer;
+struct GapEdit;
+
+enum UndoKind
+{
+    UNDO_INSERT,
+    UNDO_DELETE,
+    UNDO_REPLACE
+};
+
+// one edit: `len` bytes inserted or deleted at `at`, followed by the bytes.
+// A replace starts at its first match and holds `len` bytes laid out as a
+// struct UndoReplace.
+struct UndoRecord
+{
+    size_t prev; // size of the record before this one
+    size_t size; // size of this record with its bytes, padded
+    int kind;
+    ssize_t at;
+    ssize_t len;
+    char data[];
+};
+
+// a match that was replaced, by where it was and how long it was
+struct UndoMatch
+{
+    ssize_t at;
+    ssize_t len;
+};
+
+// every match replaced with the same bytes in one edit. The matches are
+// followed by the bytes put in their place, then by the bytes each held.
+struct UndoReplace
+{
+    ssize_t count;
+    ssize_t with_len;
+    struct UndoMatch match[];
+};
+
+// Edits recorded back to back in one buffer, oldest first. Records before
+// `pos` can be undone and those after it redone. Runs of single character
+// edits are merged into one record, and the oldest records are dropped to
+// keep the log under `limit` bytes.
+struct UndoLog
+{
+    char* buf;
+    size_t cap;
+    size_t used;
+    size_t pos;
+    size_t top;   // offset of the record just before pos
+    size_t limit;
+    int open;     // the record before pos can take more typing
+};
+
+struct UndoLog*
+Undo_new(size_t limit);
+
+void
+Undo_free(struct UndoLog* log);
+
+void
+Undo_insert(struct UndoLog* log, ssize_t at, const char* s, ssize_t len);
+
+void
+Undo_delete(struct UndoLog* log,
+            struct GapBuffer* gap,
+            ssize_t at,
+            ssize_t len);
+
+int
+Undo_replace(struct UndoLog* log,
+             struct GapBuffer* gap,
+             const struct GapEdit* edits,
+             ssize_t n);
+
+struct GapEdit*
+Undo_replace_edits(struct UndoRecord* rec, int revert);
+
+void
+Undo_seal(struct UndoLog* log);
+
+struct UndoRecord*
+Undo_undo(struct UndoLog* log);
+
+struct UndoRecord*
+Undo_redo(struct UndoLog* log);
+#endif // !UNDO_LOG
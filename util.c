@@ -26,34 +26,6 @@ Tcsetattr(int __fd, int optional, struct termios* tios)
     }
 }
 
-void*
-Malloc(size_t size)
-{
-    void* ptr = malloc(size);
-    if (!ptr) {
-        unix_error("malloc");
-    }
-    return ptr;
-}
-void*
-Calloc(size_t count, size_t size)
-{
-    void* ptr = calloc(count, size);
-    if (!ptr) {
-        unix_error("calloc");
-    }
-    return ptr;
-}
-
-void*
-Realloc(void* ptr, size_t size)
-{
-    void* new_ptr = realloc(ptr, size);
-    if (!new_ptr) {
-        unix_error("realloc");
-    }
-    return new_ptr;
-}
 FILE*
 Fopen(char* file, char* opts)
 {
@@ -10,12 +10,6 @@ void
 Tcgetattr(int __fd, struct termios* tios);
 void
 Tcsetattr(int __fd, int optional, struct termios* tios);
-void*
-Malloc(size_t size);
-void*
-Calloc(size_t count, size_t size);
-void*
-Realloc(void* ptr, size_t size);
 FILE*
 Fopen(char* file, char* opts);
 #endif // !LIBCW
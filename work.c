@@ -0,0 +1,123 @@
+#include "work.h"
+#include "mem.h"
+#include "util.h"
+
+// take the next job of the current batch and run it. Called with the lock
+// held, returns with it held. Returns 0 if there was nothing left to take.
+static int
+Work_take(struct WorkPool* pool)
+{
+    if (pool->next >= pool->jobs) {
+        return 0;
+    }
+    int job = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+    pool->fn(pool->arg, job);
+    pthread_mutex_lock(&pool->lock);
+    if (++pool->finished == pool->jobs) {
+        pthread_cond_signal(&pool->done);
+    }
+    return 1;
+}
+
+static void*
+Work_loop(void* arg)
+{
+    struct WorkPool* pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    // workers number themselves from 1, so those past the number taking
+    // part stay idle
+    int id = ++pool->started;
+    while (!pool->stop) {
+        if (id >= pool->threads || !Work_take(pool)) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// a pool of `threads` threads, counting the one that calls Work_run
+struct WorkPool*
+Work_new(int threads)
+{
+    struct WorkPool* pool = Mem_alloc(MEM_OTHER, sizeof(*pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->jobs = 0;
+    pool->next = 0;
+    pool->finished = 0;
+    pool->threads = threads < 1 ? 1 : threads;
+    pool->created = pool->threads;
+    pool->started = 0;
+    pool->stop = 0;
+    pool->tids = Mem_alloc(MEM_OTHER, sizeof(*pool->tids) * pool->created);
+    for (int i = 1; i < pool->created; i++) {
+        if (pthread_create(&pool->tids[i], NULL, Work_loop, pool)) {
+            unix_error("pthread_create");
+        }
+    }
+    return pool;
+}
+
+// stop and join the workers, then free the pool. No batch may be running.
+void
+Work_free(struct WorkPool* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 1; i < pool->created; i++) {
+        pthread_join(pool->tids[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    Mem_free(MEM_OTHER, pool->tids, sizeof(*pool->tids) * pool->created);
+    Mem_free(MEM_OTHER, pool, sizeof(*pool));
+}
+
+int
+Work_threads(struct WorkPool* pool)
+{
+    return pool->threads;
+}
+
+// let only `threads` of the pool's threads take part in later batches, at
+// most as many as it was made with, e.g. to compare thread counts on one
+// pool. Called between batches.
+void
+Work_set_threads(struct WorkPool* pool, int threads)
+{
+    pthread_mutex_lock(&pool->lock);
+    if (threads > pool->created) {
+        threads = pool->created;
+    }
+    pool->threads = threads < 1 ? 1 : threads;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// run fn(arg, 0) ... fn(arg, jobs - 1) across the pool and wait for all of
+// them to finish. The calling thread works on the batch too.
+void
+Work_run(struct WorkPool* pool,
+         void (*fn)(void* arg, int job),
+         void* arg,
+         int jobs)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->jobs = jobs;
+    pool->next = 0;
+    pool->finished = 0;
+    pthread_cond_broadcast(&pool->start);
+    while (Work_take(pool))
+        ;
+    while (pool->finished < pool->jobs) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
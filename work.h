@@ -0,0 +1,41 @@
+#ifndef WORK_POOL
+#define WORK_POOL
+#include <pthread.h>
+
+// a fixed set of worker threads running parallel-for style batches of
+// jobs. Only one thread at a time may hand work to a pool.
+struct WorkPool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    void (*fn)(void* arg, int job);
+    void* arg;
+    int jobs;
+    int next;
+    int finished;
+    int threads;     // threads taking part, see Work_set_threads
+    int created;     // threads the pool was made with
+    int started;     // workers that have numbered themselves
+    int stop;        // set by Work_free to end the workers
+    pthread_t* tids; // the workers, from tids[1] as thread 0 is the caller
+};
+
+struct WorkPool*
+Work_new(int threads);
+
+void
+Work_free(struct WorkPool* pool);
+
+int
+Work_threads(struct WorkPool* pool);
+
+void
+Work_set_threads(struct WorkPool* pool, int threads);
+
+void
+Work_run(struct WorkPool* pool,
+         void (*fn)(void* arg, int job),
+         void* arg,
+         int jobs);
+#endif // !WORK_POOL